@@ -3,12 +3,15 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <list.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -34,6 +37,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -50,6 +54,74 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+#define CMD_READ_DMA 0xc8               /* READ DMA with retries. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA with retries. */
+
+/* Most sectors a single READ/WRITE SECTOR command can transfer.
+   A sector count of 0 in the command means this many. */
+#define MAX_SECTORS_PER_CMD 256
+
+/* PCI configuration space access ports and the registers of an
+   IDE controller function that we use.  See [PCI] and [BMIDE]. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+#define PCI_REG_ID 0x00                 /* Device ID:Vendor ID. */
+#define PCI_REG_COMMAND 0x04            /* Status:Command. */
+#define PCI_REG_CLASS 0x08              /* Class:Subclass:Prog IF:Rev. */
+#define PCI_REG_BAR4 0x20               /* Bus-master register block. */
+#define PCI_CMD_IO 0x0001               /* I/O space enable. */
+#define PCI_CMD_MASTER 0x0004           /* Bus-master enable. */
+#define PCI_CLASS_IDE 0x0101            /* Mass storage, IDE. */
+#define PCI_PROGIF_MASTER 0x80          /* Supports bus mastering. */
+
+/* Bus-master IDE register port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus-master Status Register bits. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERROR 0x02       /* Transfer failed (write 1 to clear). */
+#define BM_STA_IRQ 0x04         /* Interrupt raised (write 1 to clear). */
+
+/* A physical region descriptor: one piece of memory that a DMA
+   transfer reads or writes.  A region may not cross a 64 kB
+   boundary, so we simply describe the buffer page by page. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last descriptor. */
+  };
+#define PRD_EOT 0x8000
+
+/* A read or write of consecutive sectors waiting in, or being
+   served from, a channel's request queue.  Lives on the stack of
+   the thread that submitted it, which sleeps on DONE. */
+struct ide_request
+  {
+    struct list_elem elem;      /* Element in queue or active batch. */
+    struct ata_disk *disk;      /* Disk to transfer with. */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    uint8_t *buffer;            /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool read;                  /* Read from the disk? */
+    int64_t deadline;           /* Served first once this tick passes. */
+    struct semaphore done;      /* Up'd when the transfer completes. */
+  };
+
+/* Ticks a request may wait before it is served ahead of the
+   elevator order. */
+#define IDE_DEADLINE (TIMER_FREQ / 2)
+
+/* Bus-master DMA is used only if set by the -ide-dma option and
+   the controller and disk support it. */
+bool ide_use_dma;
+
 /* An ATA device. */
 struct ata_disk
   {
@@ -57,6 +129,7 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Transfer with bus-master DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -67,11 +140,24 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus-master base I/O port, 0 if none. */
+    struct prd *prdt;           /* PRD table, one page. */
+
+    /* Request scheduling.  Accessed with interrupts off. */
+    struct list queue;          /* Waiting requests, oldest first. */
+    struct list active;         /* Batch of requests being served. */
+    bool busy;                  /* Is a batch in progress? */
+    bool batch_dma;             /* Is the batch transferred by DMA? */
+    bool batch_read;            /* Is the batch a read? */
+    size_t batch_left;          /* Sectors of the batch still to move. */
+    struct list_elem *cur;      /* Request of the next PIO sector. */
+    size_t cur_ofs;             /* Sector within CUR. */
+    uint64_t head_pos;          /* Elevator position, see request_pos(). */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,19 +167,30 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
+static void issue_command (struct channel *, uint8_t command);
+static bool dma_usable (const struct ata_disk *, const void *buffer);
+static void ide_submit (struct ata_disk *, block_sector_t, size_t cnt,
+                        void *buffer, bool read);
+static void start_next_batch (struct channel *);
+static void continue_batch (struct channel *, uint8_t status,
+                            uint8_t bm_status);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool poll_drq (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
+static void poll_until_idle (const struct ata_disk *);
+static void select_device_poll (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
@@ -102,6 +199,14 @@ void
 ide_init (void) 
 {
   size_t chan_no;
+  uint16_t bm_base = 0;
+
+  if (ide_use_dma)
+    {
+      bm_base = find_bus_master ();
+      if (bm_base == 0)
+        printf ("ide: no bus-master IDE controller, using PIO\n");
+    }
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
@@ -123,9 +228,20 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      list_init (&c->queue);
+      list_init (&c->active);
+      c->busy = false;
+      c->head_pos = 0;
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +252,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -157,6 +274,59 @@ ide_init (void)
 
 /* Disk detection and identification. */
 
+/* Reads 32-bit register REG of PCI function BUS:DEV.FUNC. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes DATA to 32-bit register REG of PCI function
+   BUS:DEV.FUNC. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t data)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, data);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus
+   mastering, such as the PIIX function emulated by QEMU and Bochs,
+   and enables bus mastering on it.  Returns the base I/O port of
+   its bus-master registers, or 0 if there is no such controller. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4, command;
+
+        if ((pci_read_config (0, dev, func, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+        class = pci_read_config (0, dev, func, PCI_REG_CLASS);
+        if ((class >> 16) != PCI_CLASS_IDE
+            || !((class >> 8) & PCI_PROGIF_MASTER))
+          continue;
+        bar4 = pci_read_config (0, dev, func, PCI_REG_BAR4);
+        if (!(bar4 & 1) || (bar4 & ~3u) == 0)
+          continue;
+
+        command = pci_read_config (0, dev, func, PCI_REG_COMMAND);
+        pci_write_config (0, dev, func, PCI_REG_COMMAND,
+                          (command & 0xffff) | PCI_CMD_IO | PCI_CMD_MASTER);
+        printf ("ide: bus-master IDE controller at PCI 00:%02x.%d\n",
+                dev, func);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 static char *descramble_ata_string (char *, int size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -281,13 +451,17 @@ identify_ata_device (struct ata_disk *d)
     }
   input_sector (c, id);
 
+  /* Word 49 bit 8 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\"%s", model, serial,
+            d->dma ? ", DMA" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -337,23 +511,52 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt, void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      ide_submit (d_, sec_no, n, buffer, true);
+      buffer += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer_)
+{
+  uint8_t *buffer = (uint8_t *) buffer_;
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      ide_submit (d_, sec_no, n, buffer, false);
+      buffer += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read (void *d, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_multiple (d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -362,38 +565,34 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  ide_write_multiple (d, sec_no, 1, buffer);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, which must be between 1
+   and MAX_SECTORS_PER_CMD, to the disk's sector selection
+   registers.  (We use LBA mode.)  Busy-waits, because it is
+   called with interrupts off, also from the interrupt handler. */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_SECTORS_PER_CMD);
   
-  select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  select_device_poll (d);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -410,10 +609,307 @@ issue_pio_command (struct channel *c, uint8_t command)
      up'd by the completion handler. */
   ASSERT (intr_get_level () == INTR_ON);
 
+  issue_command (c, command);
+}
+
+/* Writes COMMAND to channel C and prepares for receiving a
+   completion interrupt, which will be handled as part of C's
+   active batch.  Also used from the interrupt handler. */
+static void
+issue_command (struct channel *c, uint8_t command) 
+{
   c->expecting_interrupt = true;
   outb (reg_command (c), command);
 }
 
+/* Returns true if BUFFER can be transferred to or from disk D by
+   DMA.  Kernel virtual memory maps physical memory one to one,
+   so any kernel buffer is physically contiguous; the controller
+   only requires it to be word aligned. */
+static bool
+dma_usable (const struct ata_disk *d, const void *buffer)
+{
+  return d->dma && is_kernel_vaddr (buffer) && ((uintptr_t) buffer & 1) == 0;
+}
+
+/* Request scheduling.
+
+   Each channel keeps a queue of waiting requests.  When the
+   channel is idle, start_next_batch() picks the next request in
+   C-LOOK order: the lowest position at or above the last one
+   served, wrapping around to the lowest position overall.  A
+   request that has waited longer than IDE_DEADLINE is served
+   first instead, so a stream of nearby requests cannot starve
+   it.  Queued requests that extend the chosen one on either side
+   (same disk and direction, adjacent sectors) are merged with it
+   into a batch moved by a single ATA command.
+
+   The batch is then driven by interrupt_handler(), which moves
+   the PIO sectors or finishes the DMA transfer, wakes the
+   submitters when the batch is done and starts the next one.
+   Requests are only touched with interrupts off. */
+
+/* Submits a transfer of CNT sectors, at most MAX_SECTORS_PER_CMD,
+   starting at SEC_NO between disk D and BUFFER, from the disk if
+   READ is true and to it otherwise, and waits for it to
+   complete. */
+static void
+ide_submit (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+            void *buffer, bool read)
+{
+  struct channel *c = d->channel;
+  struct ide_request r;
+  enum intr_level old_level;
+
+  /* Interrupts must be enabled or the request will never be
+     completed by the interrupt handler. */
+  ASSERT (intr_get_level () == INTR_ON);
+  ASSERT (cnt >= 1 && cnt <= MAX_SECTORS_PER_CMD);
+
+  r.disk = d;
+  r.sector = sec_no;
+  r.cnt = cnt;
+  r.buffer = buffer;
+  r.read = read;
+  r.deadline = timer_ticks () + IDE_DEADLINE;
+  sema_init (&r.done, 0);
+
+  old_level = intr_disable ();
+  list_push_back (&c->queue, &r.elem);
+  if (!c->busy)
+    start_next_batch (c);
+  intr_set_level (old_level);
+
+  sema_down (&r.done);
+}
+
+/* Returns the elevator position of the sector just past R.  The
+   disks of a channel are ordered one after the other. */
+static uint64_t
+request_pos (const struct ide_request *r, block_sector_t sector)
+{
+  return ((uint64_t) r->disk->dev_no << 32) | sector;
+}
+
+/* Picks the request in C's queue to serve next. */
+static struct ide_request *
+pick_request (struct channel *c)
+{
+  struct ide_request *oldest, *next = NULL, *lowest = NULL;
+  struct list_elem *e;
+
+  oldest = list_entry (list_front (&c->queue), struct ide_request, elem);
+  if (timer_ticks () >= oldest->deadline)
+    return oldest;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct ide_request *r = list_entry (e, struct ide_request, elem);
+      uint64_t pos = request_pos (r, r->sector);
+      if (pos >= c->head_pos
+          && (next == NULL || pos < request_pos (next, next->sector)))
+        next = r;
+      if (lowest == NULL || pos < request_pos (lowest, lowest->sector))
+        lowest = r;
+    }
+  return next != NULL ? next : lowest;
+}
+
+/* Moves the queued requests that can be merged with C's active
+   batch, which runs from sector FIRST for CNT sectors, into it. */
+static void
+merge_requests (struct channel *c, block_sector_t first, size_t cnt)
+{
+  struct ide_request *head
+    = list_entry (list_front (&c->active), struct ide_request, elem);
+  bool merged;
+
+  do
+    {
+      struct list_elem *e;
+
+      merged = false;
+      for (e = list_begin (&c->queue); e != list_end (&c->queue);
+           e = list_next (e))
+        {
+          struct ide_request *r = list_entry (e, struct ide_request, elem);
+          if (r->disk != head->disk || r->read != head->read
+              || cnt + r->cnt > MAX_SECTORS_PER_CMD
+              || (c->batch_dma && !dma_usable (r->disk, r->buffer)))
+            continue;
+          if (r->sector == first + cnt)
+            {
+              list_remove (e);
+              list_push_back (&c->active, &r->elem);
+            }
+          else if (r->sector + r->cnt == first)
+            {
+              list_remove (e);
+              list_push_front (&c->active, &r->elem);
+              first = r->sector;
+            }
+          else
+            continue;
+          cnt += r->cnt;
+          merged = true;
+          break;
+        }
+    }
+  while (merged);
+  c->batch_left = cnt;
+}
+
+/* Fills C's PRD table with the buffers of its active batch and
+   loads it into the controller. */
+static void
+load_prd_table (struct channel *c)
+{
+  struct prd *prd = c->prdt;
+  struct list_elem *e;
+
+  /* Describe each buffer one page at a time.  A batch has at most
+     MAX_SECTORS_PER_CMD sectors, so at most 2 * MAX_SECTORS_PER_CMD
+     descriptors, which fit in one page. */
+  for (e = list_begin (&c->active); e != list_end (&c->active);
+       e = list_next (e))
+    {
+      struct ide_request *r = list_entry (e, struct ide_request, elem);
+      uint8_t *p = r->buffer;
+      size_t left = r->cnt * BLOCK_SECTOR_SIZE;
+
+      while (left > 0)
+        {
+          size_t size = PGSIZE - pg_ofs (p);
+          if (size > left)
+            size = left;
+          prd->addr = vtop (p);
+          prd->size = size;
+          prd->flags = 0;
+          prd++;
+          p += size;
+          left -= size;
+        }
+    }
+  prd[-1].flags = PRD_EOT;
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+}
+
+/* Returns the buffer for the next sector of C's active batch
+   moved by PIO and advances past it. */
+static uint8_t *
+next_pio_sector (struct channel *c)
+{
+  struct ide_request *r = list_entry (c->cur, struct ide_request, elem);
+  uint8_t *p = r->buffer + c->cur_ofs * BLOCK_SECTOR_SIZE;
+
+  if (++c->cur_ofs == r->cnt)
+    {
+      c->cur = list_next (c->cur);
+      c->cur_ofs = 0;
+    }
+  c->batch_left--;
+  return p;
+}
+
+/* Starts serving the next batch of requests from C's queue, if
+   any.  Interrupts must be off. */
+static void
+start_next_batch (struct channel *c)
+{
+  struct ide_request *r;
+  struct ata_disk *d;
+  block_sector_t first;
+  uint8_t dma_dir;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  c->busy = false;
+  if (list_empty (&c->queue))
+    return;
+
+  r = pick_request (c);
+  d = r->disk;
+  list_remove (&r->elem);
+  list_push_back (&c->active, &r->elem);
+  c->busy = true;
+  c->batch_read = r->read;
+  c->batch_dma = dma_usable (d, r->buffer);
+  merge_requests (c, r->sector, r->cnt);
+
+  r = list_entry (list_front (&c->active), struct ide_request, elem);
+  first = r->sector;
+  c->cur = list_begin (&c->active);
+  c->cur_ofs = 0;
+  c->head_pos = request_pos (r, first + c->batch_left);
+
+  select_sectors (d, first, c->batch_left);
+  if (c->batch_dma)
+    {
+      dma_dir = c->batch_read ? BM_CMD_READ : 0;
+      load_prd_table (c);
+      outb (reg_bm_command (c), dma_dir);
+      outb (reg_bm_status (c), BM_STA_ERROR | BM_STA_IRQ);
+      issue_command (c, c->batch_read ? CMD_READ_DMA : CMD_WRITE_DMA);
+      outb (reg_bm_command (c), dma_dir | BM_CMD_START);
+    }
+  else if (c->batch_read)
+    issue_command (c, CMD_READ_SECTOR_RETRY);
+  else
+    {
+      /* The disk asks for the first sector without an interrupt. */
+      issue_command (c, CMD_WRITE_SECTOR_RETRY);
+      if (!poll_drq (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, first);
+      output_sector (c, next_pio_sector (c));
+    }
+}
+
+/* Handles an interrupt for C's active batch, whose disk reported
+   STATUS and whose bus master reported BM_STATUS: moves the next
+   PIO sector or, once the batch is done, completes its requests
+   and starts the next batch. */
+static void
+continue_batch (struct channel *c, uint8_t status, uint8_t bm_status)
+{
+  struct ide_request *r
+    = list_entry (list_front (&c->active), struct ide_request, elem);
+  const char *op = c->batch_read ? "read" : "write";
+
+  if (c->batch_dma)
+    {
+      outb (reg_bm_command (c), c->batch_read ? BM_CMD_READ : 0);
+      if ((bm_status & BM_STA_ERROR) || (status & STA_ERR))
+        PANIC ("%s: DMA %s failed, sector=%"PRDSNu, r->disk->name, op,
+               r->sector);
+      c->batch_left = 0;
+    }
+  else if (c->batch_left > 0)
+    {
+      if ((status & STA_ERR) || !(status & STA_DRQ))
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu, r->disk->name, op,
+               r->sector);
+      if (c->batch_read)
+        input_sector (c, next_pio_sector (c));
+      else
+        output_sector (c, next_pio_sector (c));
+      /* A write is done once the disk acknowledges its last
+         sector with one more interrupt. */
+      if (!c->batch_read || c->batch_left > 0)
+        return;
+    }
+  else if (status & STA_ERR)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu, r->disk->name, op,
+           r->sector);
+
+  while (!list_empty (&c->active))
+    {
+      r = list_entry (list_pop_front (&c->active), struct ide_request, elem);
+      sema_up (&r->done);
+    }
+  start_next_batch (c);
+}
+
 /* Reads a sector from channel C's data register in PIO mode into
    SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
 static void
@@ -479,6 +975,25 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Busy-waits up to 1 second for disk D to clear BSY, and then
+   returns the status of the DRQ bit.  Unlike wait_while_busy(),
+   may be used with interrupts off. */
+static bool
+poll_drq (const struct ata_disk *d) 
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < 100000; i++)
+    {
+      uint8_t status = inb (reg_alt_status (c));
+      if (!(status & STA_BSY))
+        return (status & STA_DRQ) != 0;
+      timer_udelay (10);
+    }
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -502,6 +1017,40 @@ select_device_wait (const struct ata_disk *d)
   wait_until_idle (d);
 }
 
+/* Busy-waits up to 1 second for the controller to become idle,
+   as wait_until_idle(), but may be used with interrupts off. */
+static void
+poll_until_idle (const struct ata_disk *d) 
+{
+  int i;
+
+  for (i = 0; i < 100000; i++) 
+    {
+      if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
+        return;
+      timer_udelay (10);
+    }
+
+  printf ("%s: idle timeout\n", d->name);
+}
+
+/* Selects disk D in its channel, as select_device_wait(), but
+   busy-waits so that it may be used with interrupts off. */
+static void
+select_device_poll (const struct ata_disk *d) 
+{
+  struct channel *c = d->channel;
+  uint8_t dev = DEV_MBS;
+  if (d->dev_no == 1)
+    dev |= DEV_DEV;
+
+  poll_until_idle (d);
+  outb (reg_device (c), dev);
+  inb (reg_alt_status (c));
+  timer_ndelay (400);
+  poll_until_idle (d);
+}
+
 /* ATA interrupt handler. */
 static void
 interrupt_handler (struct intr_frame *f) 
@@ -513,8 +1062,20 @@ interrupt_handler (struct intr_frame *f)
       {
         if (c->expecting_interrupt) 
           {
-            inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            uint8_t status = inb (reg_status (c)); /* Acknowledge. */
+            uint8_t bm_status = 0;
+            if (c->bm_base != 0)
+              {
+                /* Clear the bus-master IRQ bit only: writing back
+                   BM_STA_ERROR would clear a pending error too. */
+                bm_status = inb (reg_bm_status (c));
+                outb (reg_bm_status (c),
+                      (bm_status & ~BM_STA_ERROR) | BM_STA_IRQ);
+              }
+            if (c->busy)
+              continue_batch (c, status, bm_status); /* Drive the batch. */
+            else
+              sema_up (&c->completion_wait);    /* Wake up waiter. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
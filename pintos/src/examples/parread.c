@@ -0,0 +1,118 @@
+/* parread.c
+
+   Starts several processes that each read their own file over
+   and over, to measure how well reads from different processes
+   proceed in parallel.  Compare the "Timer: N ticks" line the
+   kernel prints at shutdown.
+
+   usage: parread [PROCS [PASSES]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define MAX_PROCS 8
+#define FILE_SIZE (64 * 1024)
+
+static char buffer[4096];
+
+/* Reads file NAME from start to end PASSES times. */
+static int
+child (const char *name, int passes)
+{
+  int fd, i;
+
+  fd = open (name);
+  if (fd < 0)
+    {
+      printf ("%s: open failed\n", name);
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < passes; i++)
+    {
+      int total = 0, bytes_read;
+
+      seek (fd, 0);
+      while ((bytes_read = read (fd, buffer, sizeof buffer)) > 0)
+        total += bytes_read;
+      if (total != FILE_SIZE)
+        {
+          printf ("%s: read %d bytes, expected %d\n",
+                  name, total, FILE_SIZE);
+          return EXIT_FAILURE;
+        }
+    }
+  close (fd);
+  return EXIT_SUCCESS;
+}
+
+/* Creates file NAME with FILE_SIZE bytes of data. */
+static bool
+make_file (const char *name)
+{
+  int fd, ofs;
+
+  if (!create (name, 0))
+    return false;
+  fd = open (name);
+  if (fd < 0)
+    return false;
+  memset (buffer, name[sizeof "parread" - 1], sizeof buffer);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buffer)
+    if (write (fd, buffer, sizeof buffer) != sizeof buffer)
+      return false;
+  close (fd);
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[MAX_PROCS];
+  char name[16], cmd[64];
+  int procs = 4, passes = 16;
+  int i, retval = EXIT_SUCCESS;
+
+  if (argc == 4 && !strcmp (argv[1], "-c"))
+    return child (argv[2], atoi (argv[3]));
+  if (argc > 1)
+    procs = atoi (argv[1]);
+  if (argc > 2)
+    passes = atoi (argv[2]);
+  if (procs < 1 || procs > MAX_PROCS || passes < 1)
+    {
+      printf ("usage: parread [PROCS [PASSES]], PROCS <= %d\n", MAX_PROCS);
+      return EXIT_FAILURE;
+    }
+
+  /* Create one file per process. */
+  for (i = 0; i < procs; i++)
+    {
+      snprintf (name, sizeof name, "parread%d", i);
+      if (!make_file (name))
+        {
+          printf ("%s: create failed\n", name);
+          return EXIT_FAILURE;
+        }
+    }
+
+  /* Start the readers, then wait for all of them. */
+  for (i = 0; i < procs; i++)
+    {
+      snprintf (cmd, sizeof cmd, "parread -c parread%d %d", i, passes);
+      pids[i] = exec (cmd);
+    }
+  for (i = 0; i < procs; i++)
+    if (pids[i] == PID_ERROR || wait (pids[i]) != EXIT_SUCCESS)
+      retval = EXIT_FAILURE;
+
+  for (i = 0; i < procs; i++)
+    {
+      snprintf (name, sizeof name, "parread%d", i);
+      remove (name);
+    }
+  printf ("parread: %d processes x %d passes of %d bytes: %s\n",
+          procs, passes, FILE_SIZE, retval == EXIT_SUCCESS ? "ok" : "FAILED");
+  return retval;
+}
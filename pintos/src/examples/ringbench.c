@@ -0,0 +1,140 @@
+/* ringbench.c
+
+   Creates, opens, writes, closes and removes a number of small
+   files, either with one system call per operation ("trap") or
+   batched through a submission ring ("ring").  Run it once in
+   each mode and compare the "Timer: N ticks" line the kernel
+   prints at shutdown.
+
+   usage: ringbench trap|ring [FILES] */
+
+#include <ring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define MAX_FILES 128
+#define DIR_NAME "ringbench"
+
+static char names[MAX_FILES][32];
+static int fds[MAX_FILES];
+static char data[512];
+static struct ring ring;
+
+/* Operations on file I, one per step. */
+enum step { CREATE, OPEN, WRITE, CLOSE, REMOVE, STEP_CNT };
+
+/* Runs STEP on file I with a system call and returns its result. */
+static int
+run_trap (enum step step, int i)
+{
+  switch (step)
+    {
+    case CREATE:
+      return create (names[i], 0);
+    case OPEN:
+      return fds[i] = open (names[i]);
+    case WRITE:
+      return write (fds[i], data, sizeof data);
+    case CLOSE:
+      close (fds[i]);
+      return 0;
+    default:
+      return remove (names[i]);
+    }
+}
+
+/* Queues STEP on file I in the ring. */
+static void
+queue_step (enum step step, int i)
+{
+  static const int ops[STEP_CNT] =
+    {RING_CREATE, RING_OPEN, RING_WRITE, RING_CLOSE, RING_REMOVE};
+  void *addr = step == WRITE ? (void *) data : (void *) names[i];
+  unsigned len = step == WRITE ? sizeof data : 0;
+
+  if (!ring_queue (&ring, ops[step], fds[i], addr, len, i))
+    {
+      printf ("ringbench: ring full\n");
+      exit (EXIT_FAILURE);
+    }
+}
+
+/* Checks the result of STEP on file I. */
+static void
+check (enum step step, int i, int result)
+{
+  static const char *step_names[STEP_CNT] =
+    {"create", "open", "write", "close", "remove"};
+
+  if ((step == OPEN && result < 2)
+      || (step == WRITE && result != (int) sizeof data)
+      || ((step == CREATE || step == REMOVE) && !result))
+    {
+      printf ("%s: %s failed\n", names[i], step_names[step]);
+      exit (EXIT_FAILURE);
+    }
+  if (step == OPEN)
+    fds[i] = result;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int files = 64;
+  bool use_ring;
+  int step, i;
+
+  if (argc < 2 || argc > 3
+      || (strcmp (argv[1], "trap") && strcmp (argv[1], "ring")))
+    {
+      printf ("usage: ringbench trap|ring [FILES]\n");
+      return EXIT_FAILURE;
+    }
+  use_ring = !strcmp (argv[1], "ring");
+  if (argc > 2)
+    files = atoi (argv[2]);
+  if (files < 1 || files > MAX_FILES)
+    {
+      printf ("ringbench: FILES must be between 1 and %d\n", MAX_FILES);
+      return EXIT_FAILURE;
+    }
+
+  if (!mkdir (DIR_NAME))
+    {
+      printf ("%s: mkdir failed\n", DIR_NAME);
+      return EXIT_FAILURE;
+    }
+  for (i = 0; i < files; i++)
+    snprintf (names[i], sizeof names[i], "%s/f%d", DIR_NAME, i);
+  memset (data, 'r', sizeof data);
+  ring_init (&ring);
+
+  /* Each step depends on the one before, so a step is done for
+     every file before the next one starts.  The ring runs up to
+     RING_ENTRIES files of a step per trap. */
+  for (step = 0; step < STEP_CNT; step++)
+    for (i = 0; i < files; )
+      if (!use_ring)
+        {
+          check (step, i, run_trap (step, i));
+          i++;
+        }
+      else
+        {
+          struct ring_cqe cqe;
+          int batch;
+
+          for (batch = 0; batch < RING_ENTRIES && i + batch < files; batch++)
+            queue_step (step, i + batch);
+          ring_submit (&ring);
+          while (ring_complete (&ring, &cqe))
+            check (step, cqe.user_data, cqe.result);
+          i += batch;
+        }
+
+  remove (DIR_NAME);
+  printf ("ringbench: %s ran %d operations\n", argv[1], files * STEP_CNT);
+  return EXIT_SUCCESS;
+}
@@ -1,111 +1,632 @@
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include <hash.h>
 #include <string.h>
+#include <stdlib.h>
+#include <round.h>
 #include <debug.h>
 #include <stdio.h>
 
 /* GXY's code begin */
 
-static struct lock cache_lock;
+// Entries are indexed by sector in bucket_cnt buckets, each with its own lock,
+// so a hit only holds the lock of one bucket for a short lookup.
+// Lock order: entry lock -> cache_evict_lock -> bucket lock.
+// The one exception is the lock of a victim, taken with cache_evict_lock held;
+// it never blocks, as the victim is detached and unpinned and so no one holds it.
+// The sector and occupied fields of an entry only change with cache_evict_lock held.
+struct cache_bucket {
+  struct lock lock;
+  struct list entries;
+};
 
-static struct cache_entry cache[BLOCK_SECTOR_SIZE];
+static struct cache_bucket *buckets;
+static size_t bucket_cnt;
+
+// Serializes replacement, which is the only way entries move between buckets
+static struct lock cache_evict_lock;
+
+size_t cache_size = BLOCK_CACHE_SIZE;
+static struct cache_entry *cache;
+
+// Sectors waiting for the read-ahead thread, dropped when the queue is full
+#define READAHEAD_QUEUE_SIZE 64
+static block_sector_t readahead_queue[READAHEAD_QUEUE_SIZE];
+static size_t readahead_head, readahead_cnt;
+static struct lock readahead_lock;
+static struct condition readahead_cond;
+
+// Read-ahead statistics
+static unsigned long long prefetch_cnt, prefetch_hit_cnt, prefetch_wasted_cnt;
+// Replacement statistics, hits and misses count foreground accesses only
+static unsigned long long hit_cnt, miss_cnt, evict_cnt;
+
+static enum cache_policy cache_policy = CACHE_CLOCK;
+
+// Entries never used yet
+static struct list free_entries;
+
+// 2Q state, protected by cache_evict_lock.
+// New sectors enter a1in, a FIFO; sectors pushed out of a1in are remembered in the
+// a1out ring of sector numbers, and a miss on one of them goes to am, which is a clock.
+// A one-shot scan thus only cycles through a1in and leaves am alone.
+// The sectors in a1out are also hashed, so every miss checks it in constant time.
+struct a1out_slot {
+  block_sector_t sector;
+  struct hash_elem elem;
+};
+static struct list a1in, am;
+static size_t a1in_cnt, a1in_max;
+static struct a1out_slot *a1out;
+static size_t a1out_size, a1out_head;
+static struct hash a1out_hash;
+#define A1OUT_EMPTY ((block_sector_t) -1)
+
+static unsigned a1out_hash_func(const struct hash_elem *e, void *aux UNUSED) {
+  return hash_int(hash_entry(e, struct a1out_slot, elem)->sector);
+}
+
+static bool a1out_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED) {
+  return hash_entry(a, struct a1out_slot, elem)->sector < hash_entry(b, struct a1out_slot, elem)->sector;
+}
+
+static void cache_readahead_daemon(void *aux);
+
+// Most sectors moved by one multi-sector request, through a one-page bounce buffer
+#define CACHE_IO_BATCH (PGSIZE / BLOCK_SECTOR_SIZE)
+// Bounce buffers of the read-ahead thread and of flush passes
+static uint8_t *readahead_buffer, *flush_buffer;
+// Most entries the read-ahead thread pins at once, a quarter of a small cache at most,
+// so readers always find a victim
+static size_t readahead_batch;
+
+// Milliseconds between periodic flushes of dirty entries, 0 to disable
+unsigned cache_flush_interval = 1000;
+// Percentage of dirty entries that triggers a flush before the interval ends
+unsigned cache_dirty_ratio = 50;
+// How often the write-behind thread checks the dirty ratio
+#define WRITE_BEHIND_POLL_MS 50
+
+static int dirty_cnt;
+// Serializes flush passes, which share flush_batch
+static struct lock flush_lock;
+static struct cache_entry **flush_batch;
+
+static void cache_write_behind_daemon(void *aux);
+
+static struct cache_bucket *cache_bucket_of(block_sector_t sector) {
+  return buckets + sector % bucket_cnt;
+}
+
+// Allocate the sector buffers from the kernel pool, shrinking cache_size
+// until it fits.  Returns the first of the pages.
+static uint8_t *cache_alloc_data(void) {
+  const size_t per_page = PGSIZE / BLOCK_SECTOR_SIZE;
+  if (cache_size < per_page) cache_size = per_page;
+  size_t requested = cache_size;
+  while (true) {
+    uint8_t *data = palloc_get_multiple(0, DIV_ROUND_UP(cache_size, per_page));
+    if (data != NULL) {
+      if (cache_size != requested)
+        printf("cache: only %zu of %zu sectors available\n", cache_size, requested);
+      return data;
+    }
+    if (cache_size == per_page)
+      PANIC("can't allocate buffer cache");
+    cache_size /= 2;
+    if (cache_size < per_page) cache_size = per_page;
+  }
+}
 
 void cache_init(void) {
-  lock_init(&cache_lock);
-  lock_acquire(&cache_lock);
-  for (int i = 0; i < BLOCK_CACHE_SIZE; i++)
+  uint8_t *data = cache_alloc_data();
+  bucket_cnt = DIV_ROUND_UP(cache_size, CACHE_BUCKET_LOAD);
+  cache = malloc(cache_size * sizeof *cache);
+  buckets = malloc(bucket_cnt * sizeof *buckets);
+  flush_batch = malloc(cache_size * sizeof *flush_batch);
+  a1out_size = cache_size / 2;
+  a1out = malloc(a1out_size * sizeof *a1out);
+  readahead_buffer = palloc_get_page(0);
+  flush_buffer = palloc_get_page(0);
+  if (cache == NULL || buckets == NULL || flush_batch == NULL || a1out == NULL
+      || readahead_buffer == NULL || flush_buffer == NULL
+      || !hash_init(&a1out_hash, a1out_hash_func, a1out_less, NULL))
+    PANIC("can't allocate buffer cache");
+  list_init(&free_entries);
+  list_init(&a1in);
+  list_init(&am);
+  a1in_cnt = 0;
+  a1in_max = cache_size / 4;
+  a1out_head = 0;
+  for (size_t i = 0; i < a1out_size; i++)
+    a1out[i].sector = A1OUT_EMPTY;
+
+  lock_init(&cache_evict_lock);
+  for (size_t i = 0; i < bucket_cnt; i++) {
+    lock_init(&buckets[i].lock);
+    list_init(&buckets[i].entries);
+  }
+  for (size_t i = 0; i < cache_size; i++) {
+    cache[i].data = data + i * BLOCK_SECTOR_SIZE;
     cache[i].occupied = false;
-  lock_release(&cache_lock);
+    cache[i].pin_cnt = 0;
+    cache[i].queue = CACHE_Q_NONE;
+    lock_init(&cache[i].lock);
+    list_push_back(&free_entries, &cache[i].queue_elem);
+  }
+  lock_init(&readahead_lock);
+  cond_init(&readahead_cond);
+  readahead_head = readahead_cnt = 0;
+  readahead_batch = cache_size / 4 < CACHE_IO_BATCH ? cache_size / 4 : CACHE_IO_BATCH;
+  if (readahead_batch == 0) readahead_batch = 1;
+  thread_create("readahead", PRI_DEFAULT, cache_readahead_daemon, NULL);
+  lock_init(&flush_lock);
+  dirty_cnt = 0;
+  thread_create("write-behind", PRI_DEFAULT, cache_write_behind_daemon, NULL);
+}
+
+// Find sector in bucket and pin it, the bucket lock must be held
+static struct cache_entry *cache_bucket_lookup(struct cache_bucket *bucket, block_sector_t sector) {
+  for (struct list_elem *e = list_begin(&bucket->entries); e != list_end(&bucket->entries); e = list_next(e)) {
+    struct cache_entry *entry = list_entry(e, struct cache_entry, elem);
+    if (entry->sector == sector) {
+      entry->pin_cnt++;
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static void cache_unpin(struct cache_entry *entry) {
+  struct cache_bucket *bucket = cache_bucket_of(entry->sector);
+  lock_acquire(&bucket->lock);
+  entry->pin_cnt--;
+  lock_release(&bucket->lock);
+}
+
+// Pin an occupied entry, cache_evict_lock must be held
+static bool cache_pin_occupied(struct cache_entry *entry) {
+  if (!entry->occupied) return false;
+  struct cache_bucket *bucket = cache_bucket_of(entry->sector);
+  lock_acquire(&bucket->lock);
+  entry->pin_cnt++;
+  lock_release(&bucket->lock);
+  return true;
+}
+
+static void cache_add_dirty(int delta) {
+  enum intr_level old_level = intr_disable();
+  dirty_cnt += delta;
+  intr_set_level(old_level);
+}
+
+// Mark entry dirty, its lock must be held
+static void cache_set_dirty(struct cache_entry *entry) {
+  if (!entry->dirty) {
+    entry->dirty = true;
+    cache_add_dirty(1);
+  }
 }
 
 static void cache_flush_one(struct cache_entry *entry) {
   if (entry->dirty) {
     block_write(fs_device, entry->sector, entry->data);
     entry->dirty = false;
+    cache_add_dirty(-1);
   }
 }
 
+static int cache_entry_sector_compare(const void *a_, const void *b_) {
+  const struct cache_entry *a = *(struct cache_entry * const *) a_;
+  const struct cache_entry *b = *(struct cache_entry * const *) b_;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+// Write back every dirty entry in increasing sector order.
+// Runs of consecutive sectors are copied into flush_buffer and written with one request;
+// the entries stay pinned until the write is done, so none of them can be evicted and
+// reread from the disk before it holds their data.
+static void cache_flush_dirty(void) {
+  lock_acquire(&flush_lock);
+  size_t cnt = 0;
+  lock_acquire(&cache_evict_lock);
+  for (size_t i = 0; i < cache_size; i++)
+    if (cache[i].occupied && cache[i].dirty && cache_pin_occupied(cache + i))
+      flush_batch[cnt++] = cache + i;
+  lock_release(&cache_evict_lock);
+
+  qsort(flush_batch, cnt, sizeof *flush_batch, cache_entry_sector_compare);
+  for (size_t i = 0; i < cnt; ) {
+    block_sector_t start = flush_batch[i]->sector;
+    size_t n = 0;
+    while (i + n < cnt && n < CACHE_IO_BATCH && flush_batch[i + n]->sector == start + n) {
+      struct cache_entry *entry = flush_batch[i + n];
+      lock_acquire(&entry->lock);
+      memcpy(flush_buffer + n * BLOCK_SECTOR_SIZE, entry->data, BLOCK_SECTOR_SIZE);
+      if (entry->dirty) {
+        entry->dirty = false;
+        cache_add_dirty(-1);
+      }
+      lock_release(&entry->lock);
+      n++;
+    }
+    block_write_multiple(fs_device, start, n, flush_buffer);
+    for (size_t j = 0; j < n; j++)
+      cache_unpin(flush_batch[i + j]);
+    i += n;
+  }
+  lock_release(&flush_lock);
+}
+
 // Flush everything in block buffer
 void cache_flush(void) {
-  //lock_acquire(&cache_lock);
-  for (int i = 0; i < BLOCK_CACHE_SIZE; i++)
-    if (cache[i].occupied)
-      cache_flush_one(cache + i);
-  //lock_release(&cache_lock);
+  cache_flush_dirty();
+}
+
+// Periodically writes dirty entries back, so that eviction usually finds a clean victim
+static void cache_write_behind_daemon(void *aux UNUSED) {
+  unsigned waited = 0;
+  while (true) {
+    timer_msleep(WRITE_BEHIND_POLL_MS);
+    waited += WRITE_BEHIND_POLL_MS;
+    if ((cache_flush_interval != 0 && waited >= cache_flush_interval)
+        || (unsigned) dirty_cnt * 100 >= cache_dirty_ratio * cache_size) {
+      // delayed file data and free map changes go through the cache,
+      // so they are written in the same pass
+      inode_flush_all();
+      free_map_flush();
+      cache_flush_dirty();
+      waited = 0;
+    }
+  }
+}
+
+bool cache_set_policy(const char *name) {
+  if (!strcmp(name, "clock"))
+    cache_policy = CACHE_CLOCK;
+  else if (!strcmp(name, "2q"))
+    cache_policy = CACHE_2Q;
+  else
+    return false;
+  return true;
+}
+
+// Remove an unpinned, clean entry from its bucket and queue.
+// Its bucket lock must be held.
+static void cache_detach(struct cache_entry *entry) {
+  if (entry->prefetched) prefetch_wasted_cnt++;
+  evict_cnt++;
+  list_remove(&entry->elem);
+  entry->occupied = false;
+  if (entry->queue != CACHE_Q_NONE) {
+    list_remove(&entry->queue_elem);
+    if (entry->queue == CACHE_Q_A1IN) a1in_cnt--;
+    entry->queue = CACHE_Q_NONE;
+  }
 }
 
-static struct cache_entry *cache_lookup(block_sector_t sector) {
-  for (int i = 0; i < BLOCK_CACHE_SIZE; i++)
-    if (cache[i].occupied && cache[i].sector == sector)
-      return cache + i;
+// Check whether entry can be evicted now, its bucket lock must be held.
+// Returns true if it is unpinned and clean.  If it is unpinned but dirty,
+// pins it and stores it into *dirty.
+static bool cache_evictable(struct cache_entry *entry, struct cache_entry **dirty) {
+  if (entry->pin_cnt > 0) return false;
+  if (entry->dirty) {
+    entry->pin_cnt++;
+    *dirty = entry;
+    return false;
+  }
+  return true;
+}
+
+static struct cache_entry *cache_evict_clock(struct cache_entry **dirty) {
+  static size_t clock = 0;
+  size_t scanned = 0;
+  while (true) {
+    // two sweeps clear every accessed bit, so after them every entry is in use;
+    // let their users run
+    if (scanned++ == 2 * cache_size) {
+      thread_yield();
+      scanned = 1;
+    }
+    struct cache_entry *entry = cache + clock;
+    struct cache_bucket *bucket = cache_bucket_of(entry->sector);
+    lock_acquire(&bucket->lock);
+    if (entry->pin_cnt == 0 && entry->accessed) {
+      entry->accessed = false;
+    } else if (cache_evictable(entry, dirty)) {
+      cache_detach(entry);
+      lock_release(&bucket->lock);
+      clock = (clock + 1) % cache_size;
+      return entry;
+    } else if (*dirty != NULL) {
+      lock_release(&bucket->lock);
+      return NULL;
+    }
+    lock_release(&bucket->lock);
+    clock = (clock + 1) % cache_size;
+  }
+}
+
+// Take a victim from the front of queue q, moving entries that are skipped to the back.
+// With second_chance, accessed entries are skipped once, which makes q a clock.
+static struct cache_entry *cache_evict_queue(struct list *q, bool second_chance,
+                                             struct cache_entry **dirty) {
+  size_t tries = 2 * cache_size;
+  while (!list_empty(q) && tries-- > 0) {
+    struct cache_entry *entry = list_entry(list_front(q), struct cache_entry, queue_elem);
+    struct cache_bucket *bucket = cache_bucket_of(entry->sector);
+    lock_acquire(&bucket->lock);
+    if (!(second_chance && entry->pin_cnt == 0 && entry->accessed)
+        && cache_evictable(entry, dirty)) {
+      cache_detach(entry);
+      lock_release(&bucket->lock);
+      return entry;
+    }
+    entry->accessed = false;
+    lock_release(&bucket->lock);
+    if (*dirty != NULL) return NULL;
+    list_push_back(q, list_pop_front(q));
+  }
   return NULL;
 }
 
-static struct cache_entry *cache_evict(void) {
-  static int clock = 0;
+static bool cache_a1out_remove(block_sector_t sector) {
+  struct a1out_slot key;
+  key.sector = sector;
+  struct hash_elem *e = hash_delete(&a1out_hash, &key.elem);
+  if (e == NULL) return false;
+  hash_entry(e, struct a1out_slot, elem)->sector = A1OUT_EMPTY;
+  return true;
+}
+
+// Remember sector in the oldest slot of a1out, forgetting the sector held there
+static void cache_a1out_add(block_sector_t sector) {
+  if (a1out_size == 0) return;
+  struct a1out_slot *slot = a1out + a1out_head;
+  if (slot->sector != A1OUT_EMPTY)
+    hash_delete(&a1out_hash, &slot->elem);
+  slot->sector = sector;
+  struct hash_elem *old = hash_replace(&a1out_hash, &slot->elem);
+  if (old != NULL)
+    hash_entry(old, struct a1out_slot, elem)->sector = A1OUT_EMPTY;
+  a1out_head = (a1out_head + 1) % a1out_size;
+}
+
+static struct cache_entry *cache_evict_2q(struct cache_entry **dirty) {
   while (true) {
-    if (!cache[clock].occupied) return cache + clock;
-    if (cache[clock].accessed) cache[clock].accessed = false;
-    else break;
-    clock = (clock + 1) % BLOCK_CACHE_SIZE;
+    struct cache_entry *entry = NULL;
+    if (a1in_cnt > a1in_max) {
+      entry = cache_evict_queue(&a1in, false, dirty);
+      if (entry != NULL) cache_a1out_add(entry->sector);
+    }
+    if (entry == NULL && *dirty == NULL)
+      entry = cache_evict_queue(&am, true, dirty);
+    if (entry == NULL && *dirty == NULL) {
+      entry = cache_evict_queue(&a1in, false, dirty);
+      if (entry != NULL) cache_a1out_add(entry->sector);
+    }
+    if (entry != NULL || *dirty != NULL) return entry;
+    // every entry is in use, let their users run
+    thread_yield();
   }
-  cache_flush_one(cache + clock);
-  cache[clock].occupied = false;
-  return cache + clock;
 }
 
-static struct cache_entry *cache_lookup_or_evict(block_sector_t sector, bool need_read) {
-  struct cache_entry *entry = cache_lookup(sector);
-  if (entry == NULL) {
-    entry = cache_evict();
+// Find a free or clean, unused entry and detach it from its bucket.
+// If the policy stops at a dirty entry, it is pinned and returned in *dirty instead,
+// so that the caller can write it back without holding cache_evict_lock.
+// cache_evict_lock must be held.
+static struct cache_entry *cache_evict(struct cache_entry **dirty) {
+  if (!list_empty(&free_entries))
+    return list_entry(list_pop_front(&free_entries), struct cache_entry, queue_elem);
+  *dirty = NULL;
+  if (cache_policy == CACHE_2Q)
+    return cache_evict_2q(dirty);
+  return cache_evict_clock(dirty);
+}
+
+// Put a newly filled entry into the queues of the policy, cache_evict_lock must be held
+static void cache_policy_insert(struct cache_entry *entry) {
+  if (cache_policy != CACHE_2Q) return;
+  if (cache_a1out_remove(entry->sector)) {
+    entry->queue = CACHE_Q_AM;
+    list_push_back(&am, &entry->queue_elem);
+  } else {
+    entry->queue = CACHE_Q_A1IN;
+    list_push_back(&a1in, &entry->queue_elem);
+    a1in_cnt++;
+  }
+}
+
+// Returns the entry of sector, pinned and with its lock held.
+// On a miss the disk read (if needed) and any write-back are done
+// without holding cache_evict_lock or a bucket lock.
+// If loaded is not NULL, it is set to whether this call brought the sector in.
+static struct cache_entry *cache_lookup_or_evict(block_sector_t sector, bool need_read, bool *loaded) {
+  if (loaded != NULL) *loaded = false;
+  struct cache_bucket *bucket = cache_bucket_of(sector);
+  while (true) {
+    lock_acquire(&bucket->lock);
+    struct cache_entry *entry = cache_bucket_lookup(bucket, sector);
+    lock_release(&bucket->lock);
+    if (entry != NULL) {
+      lock_acquire(&entry->lock);
+      return entry;
+    }
+
+    lock_acquire(&cache_evict_lock);
+    // no one else can insert the sector while we hold cache_evict_lock
+    lock_acquire(&bucket->lock);
+    entry = cache_bucket_lookup(bucket, sector);
+    lock_release(&bucket->lock);
+    if (entry != NULL) {
+      lock_release(&cache_evict_lock);
+      lock_acquire(&entry->lock);
+      return entry;
+    }
+
+    struct cache_entry *dirty = NULL;
+    entry = cache_evict(&dirty);
+    if (entry == NULL) {
+      lock_release(&cache_evict_lock);
+      lock_acquire(&dirty->lock);
+      cache_flush_one(dirty);
+      lock_release(&dirty->lock);
+      cache_unpin(dirty);
+      continue;
+    }
+
+    // entry is detached and unpinned, so its lock is free
+    lock_acquire(&entry->lock);
     entry->sector = sector;
-    if (need_read) block_read(fs_device, sector, entry->data);
     entry->occupied = true;
     entry->dirty = false;
     entry->accessed = false;
+    entry->prefetched = false;
+    entry->pin_cnt = 1;
+    lock_acquire(&bucket->lock);
+    list_push_back(&bucket->entries, &entry->elem);
+    lock_release(&bucket->lock);
+    cache_policy_insert(entry);
+    lock_release(&cache_evict_lock);
+
+    // other readers of this sector pin the entry and wait for its lock
+    if (need_read) block_read(fs_device, sector, entry->data);
+    if (loaded != NULL) *loaded = true;
+    return entry;
   }
+}
+
+// Get the entry of sector for a foreground access, as cache_lookup_or_evict
+static struct cache_entry *cache_get(block_sector_t sector, bool need_read) {
+  bool loaded;
+  struct cache_entry *entry = cache_lookup_or_evict(sector, need_read, &loaded);
+  if (loaded) miss_cnt++;
+  else hit_cnt++;
   return entry;
 }
 
+// Mark entry as used by a foreground access
+static void cache_touch(struct cache_entry *entry) {
+  entry->accessed = true;
+  if (entry->prefetched) {
+    entry->prefetched = false;
+    prefetch_hit_cnt++;
+  }
+}
+
+static void cache_release(struct cache_entry *entry) {
+  lock_release(&entry->lock);
+  cache_unpin(entry);
+}
+
 void cache_read(block_sector_t sector, void *dest) {
   *(uint8_t *) dest = 0; // prevent page fault
-  lock_acquire(&cache_lock);
-  struct cache_entry *entry = cache_lookup_or_evict(sector, true);
-  entry->accessed = true;
+  struct cache_entry *entry = cache_get(sector, true);
+  cache_touch(entry);
   memcpy(dest, entry->data, BLOCK_SECTOR_SIZE);
-  lock_release(&cache_lock);
+  cache_release(entry);
 }
 
 void cache_read_at(block_sector_t sector, void *dest, size_t start, size_t cnt) {
   if (cnt == 0) return;
   *(uint8_t *) dest = 0; // prevent page fault
-  lock_acquire(&cache_lock);
-  struct cache_entry *entry = cache_lookup_or_evict(sector, true);
-  entry->accessed = true;
+  struct cache_entry *entry = cache_get(sector, true);
+  cache_touch(entry);
   memcpy(dest, entry->data + start, cnt);
-  lock_release(&cache_lock);
+  cache_release(entry);
 }
 
 void cache_write(block_sector_t sector, const void *src) {
   *(uint8_t *) src = *(uint8_t *) src; // prevent page fault
-  lock_acquire(&cache_lock);
-  struct cache_entry *entry = cache_lookup_or_evict(sector, false);
-  entry->accessed = true;
-  entry->dirty = true;
+  struct cache_entry *entry = cache_get(sector, false);
+  cache_touch(entry);
+  cache_set_dirty(entry);
   memcpy(entry->data, src, BLOCK_SECTOR_SIZE);
-  lock_release(&cache_lock);
+  cache_release(entry);
 }
 
 void cache_write_at(block_sector_t sector, const void *src, size_t start, size_t cnt) {
   if (cnt == 0) return;
   *(uint8_t *) src = *(uint8_t *) src; // prevent page fault
-  lock_acquire(&cache_lock);
-  struct cache_entry *entry = cache_lookup_or_evict(sector, cnt < BLOCK_SECTOR_SIZE);
-  entry->accessed = true;
-  entry->dirty = true;
+  struct cache_entry *entry = cache_get(sector, cnt < BLOCK_SECTOR_SIZE);
+  cache_touch(entry);
+  cache_set_dirty(entry);
   memcpy(entry->data + start, src, cnt);
-  lock_release(&cache_lock);
+  cache_release(entry);
+}
+
+// Ask the read-ahead thread to bring sector into the cache
+void cache_prefetch(block_sector_t sector) {
+  lock_acquire(&readahead_lock);
+  if (readahead_cnt < READAHEAD_QUEUE_SIZE) {
+    readahead_queue[(readahead_head + readahead_cnt) % READAHEAD_QUEUE_SIZE] = sector;
+    readahead_cnt++;
+    cond_signal(&readahead_cond, &readahead_lock);
+  }
+  lock_release(&readahead_lock);
+}
+
+// Brings queued sectors in, reading runs of consecutive sectors with one request
+static void cache_readahead_daemon(void *aux UNUSED) {
+  block_sector_t sectors[CACHE_IO_BATCH];
+  struct cache_entry *entries[CACHE_IO_BATCH];
+  while (true) {
+    lock_acquire(&readahead_lock);
+    while (readahead_cnt == 0)
+      cond_wait(&readahead_cond, &readahead_lock);
+    size_t n = 0;
+    do {
+      sectors[n++] = readahead_queue[readahead_head];
+      readahead_head = (readahead_head + 1) % READAHEAD_QUEUE_SIZE;
+      readahead_cnt--;
+    } while (readahead_cnt > 0 && n < readahead_batch
+             && readahead_queue[readahead_head] == sectors[n - 1] + 1);
+    lock_release(&readahead_lock);
+
+    // claim entries for the sectors not cached yet; readers of them wait for the entry lock
+    for (size_t i = 0; i < n; i++) {
+      bool loaded;
+      entries[i] = cache_lookup_or_evict(sectors[i], false, &loaded);
+      if (!loaded) {
+        cache_release(entries[i]);
+        entries[i] = NULL;
+      }
+    }
+
+    for (size_t i = 0; i < n; ) {
+      if (entries[i] == NULL) {
+        i++;
+        continue;
+      }
+      size_t j = i;
+      while (j < n && entries[j] != NULL) j++;
+      block_read_multiple(fs_device, sectors[i], j - i, readahead_buffer);
+      for (size_t k = i; k < j; k++) {
+        memcpy(entries[k]->data, readahead_buffer + (k - i) * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+        // left unaccessed so that an unused prefetch is the first to go
+        entries[k]->prefetched = true;
+        prefetch_cnt++;
+        cache_release(entries[k]);
+      }
+      i = j;
+    }
+  }
+}
+
+void cache_print_stats(void) {
+  printf("Cache: %s policy, %zu sectors, %llu hits, %llu misses, %llu evictions\n",
+         cache_policy == CACHE_2Q ? "2q" : "clock", cache_size, hit_cnt, miss_cnt, evict_cnt);
+  printf("Cache: %llu prefetches, %llu prefetch hits, %llu wasted prefetches\n",
+         prefetch_cnt, prefetch_hit_cnt, prefetch_wasted_cnt);
 }
 
 /* GXY's code end */
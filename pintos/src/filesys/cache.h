@@ -3,26 +3,63 @@
 
 #include "devices/block.h"
 #include "threads/synch.h"
+#include <list.h>
 
 /* GXY's code begin */
 
+// Default number of cached sectors, overridden by -cache=N
 #define BLOCK_CACHE_SIZE 64
+// Cached sectors per hash bucket
+#define CACHE_BUCKET_LOAD 4
+
+// Replacement policies, selected by -cache-policy
+enum cache_policy {
+  CACHE_CLOCK,      // second chance over all entries
+  CACHE_2Q          // FIFO probation queue, clock main queue and a ghost queue
+};
+
+// Queue an entry is in under CACHE_2Q
+enum cache_queue {
+  CACHE_Q_NONE, CACHE_Q_A1IN, CACHE_Q_AM
+};
 
 struct cache_entry {
   block_sector_t sector;
-  uint8_t data[BLOCK_SECTOR_SIZE];
+  // one sector inside the kernel pages backing the cache
+  uint8_t *data;
   bool occupied;
   bool dirty;
   // used in clock replacement
   bool accessed;
+  // loaded by read-ahead and not used since
+  bool prefetched;
+  // number of threads using this entry, protected by the bucket lock
+  // an entry with pin_cnt > 0 is never evicted
+  int pin_cnt;
+  // protects data and dirty, held during disk I/O of this entry
+  struct lock lock;
+  // element in the bucket list
+  struct list_elem elem;
+  // queue and element in it used by the replacement policy
+  enum cache_queue queue;
+  struct list_elem queue_elem;
 };
 
+// Number of cached sectors, set from the kernel command line
+extern size_t cache_size;
+// Write-behind parameters, set from the kernel command line
+extern unsigned cache_flush_interval;
+extern unsigned cache_dirty_ratio;
+
 void cache_init(void);
 void cache_flush(void);
 void cache_read(block_sector_t sector, void *dest);
 void cache_read_at(block_sector_t sector, void *dest, size_t start, size_t cnt);
 void cache_write(block_sector_t sector, const void *src);
 void cache_write_at(block_sector_t sector, const void *src, size_t start, size_t cnt);
+void cache_prefetch(block_sector_t sector);
+bool cache_set_policy(const char *name);
+void cache_print_stats(void);
 
 /* GXY's code end */
 
@@ -0,0 +1,120 @@
+#include "filesys/dcache.h"
+#include "filesys/directory.h"
+#include "threads/synch.h"
+#include "threads/malloc.h"
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include <debug.h>
+
+/* GXY's code begin */
+
+// Maps the name of an entry in the directory whose inode is at sector dir
+// to the sector of its inode, or to 0 if the directory has no such entry.
+// Kept up to date by dir_add() and dir_remove(), so path resolution only
+// searches a directory on disk for names it has not seen lately.
+struct dentry {
+  block_sector_t dir;
+  char name[NAME_MAX + 1];
+  block_sector_t sector;
+  struct hash_elem elem;
+  // element in lru, most recently used first
+  struct list_elem lru_elem;
+};
+
+static struct hash dentries;
+static struct list lru;
+static size_t dentry_cnt;
+static struct lock dcache_lock;
+
+static unsigned dentry_hash(const struct hash_elem *e, void *aux UNUSED) {
+  const struct dentry *d = hash_entry(e, struct dentry, elem);
+  return hash_string(d->name) ^ hash_int(d->dir);
+}
+
+static bool dentry_less(const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED) {
+  const struct dentry *a = hash_entry(a_, struct dentry, elem);
+  const struct dentry *b = hash_entry(b_, struct dentry, elem);
+  if (a->dir != b->dir) return a->dir < b->dir;
+  return strcmp(a->name, b->name) < 0;
+}
+
+// Find the entry for name in dir, NULL if there is none. dcache_lock must be held.
+static struct dentry *dentry_find(block_sector_t dir, const char *name) {
+  struct dentry key;
+  key.dir = dir;
+  strlcpy(key.name, name, sizeof key.name);
+  struct hash_elem *e = hash_find(&dentries, &key.elem);
+  return e != NULL ? hash_entry(e, struct dentry, elem) : NULL;
+}
+
+// Drop entry d. dcache_lock must be held.
+static void dentry_remove(struct dentry *d) {
+  hash_delete(&dentries, &d->elem);
+  list_remove(&d->lru_elem);
+  dentry_cnt--;
+  free(d);
+}
+
+void dcache_init(void) {
+  hash_init(&dentries, dentry_hash, dentry_less, NULL);
+  list_init(&lru);
+  dentry_cnt = 0;
+  lock_init(&dcache_lock);
+}
+
+// Look name up in the directory at sector dir.
+// returns true iff it is cached, setting *sector to its inode sector, 0 if it does not exist
+bool dcache_lookup(block_sector_t dir, const char *name, block_sector_t *sector) {
+  if (strlen(name) > NAME_MAX) return false;
+  lock_acquire(&dcache_lock);
+  struct dentry *d = dentry_find(dir, name);
+  if (d != NULL) {
+    *sector = d->sector;
+    list_remove(&d->lru_elem);
+    list_push_front(&lru, &d->lru_elem);
+  }
+  lock_release(&dcache_lock);
+  return d != NULL;
+}
+
+// Remember that name in the directory at sector dir has its inode at sector,
+// or does not exist if sector is 0
+void dcache_insert(block_sector_t dir, const char *name, block_sector_t sector) {
+  if (strlen(name) > NAME_MAX) return;
+  lock_acquire(&dcache_lock);
+  struct dentry *d = dentry_find(dir, name);
+  if (d != NULL) {
+    list_remove(&d->lru_elem);
+  } else {
+    if (dentry_cnt == DCACHE_SIZE)
+      dentry_remove(list_entry(list_back(&lru), struct dentry, lru_elem));
+    d = malloc(sizeof *d);
+    if (d == NULL) {
+      lock_release(&dcache_lock);
+      return;
+    }
+    d->dir = dir;
+    strlcpy(d->name, name, sizeof d->name);
+    hash_insert(&dentries, &d->elem);
+    dentry_cnt++;
+  }
+  d->sector = sector;
+  list_push_front(&lru, &d->lru_elem);
+  lock_release(&dcache_lock);
+}
+
+// Forget every entry of the directory at sector dir, which is being removed,
+// as its sector may later hold another directory
+void dcache_invalidate_dir(block_sector_t dir) {
+  lock_acquire(&dcache_lock);
+  struct list_elem *e = list_begin(&lru);
+  while (e != list_end(&lru)) {
+    struct dentry *d = list_entry(e, struct dentry, lru_elem);
+    e = list_next(e);
+    if (d->dir == dir) dentry_remove(d);
+  }
+  lock_release(&dcache_lock);
+}
+
+/* GXY's code end */
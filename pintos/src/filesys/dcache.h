@@ -0,0 +1,19 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* GXY's code begin */
+
+// Number of directory entries remembered, least recently used ones are dropped
+#define DCACHE_SIZE 256
+
+void dcache_init(void);
+bool dcache_lookup(block_sector_t dir, const char *name, block_sector_t *sector);
+void dcache_insert(block_sector_t dir, const char *name, block_sector_t sector);
+void dcache_invalidate_dir(block_sector_t dir);
+
+/* GXY's code end */
+
+#endif
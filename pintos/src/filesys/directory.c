@@ -2,9 +2,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+/* GXY's code begin */
+#include "filesys/dcache.h"
+/* GXY's code end */
 /* yy's code begin */
 #include "filesys/free-map.h"
 #include "filesys/file.h"
@@ -29,15 +34,69 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* GXY's code begin */
+/* A hashed directory starts with this header in its first
+   sector, followed by BUCKET_CNT buckets of DIR_BUCKET_SLOTS
+   entries, one bucket per sector.  A name goes into the first
+   free slot from bucket hash_string(name) % BUCKET_CNT on,
+   moving on to the next bucket when one is full.  A slot that
+   was never used reads back as all zeros, since the directory
+   is a sparse file, and ends a search: no name probed past it.
+   A directory starts with few buckets and doubles them, moving
+   every entry, once 3/4 of its slots are in use.
+   Directories without the header keep a linear array of
+   entries. */
+struct dir_header
+  {
+    uint32_t magic;                     /* DIR_HASH_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t entry_cnt;                 /* Number of entries in use. */
+  };
+
+#define DIR_HASH_MAGIC 0x48444952
+#define DIR_MIN_BUCKET_CNT 2
+#define DIR_BUCKET_SLOTS (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* Returns the byte offset of bucket BUCKET in a hashed directory. */
+static inline off_t
+bucket_ofs (size_t bucket)
+{
+  return (bucket + 1) * BLOCK_SECTOR_SIZE;
+}
+/* GXY's code end */
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  if (inode_create (sector, entry_cnt * sizeof (struct dir_entry))) {
-    sector_set_isdir(sector, true);
-    return true;
-  } else return false;
+  /* old code begin */
+  // if (inode_create (sector, entry_cnt * sizeof (struct dir_entry))) {
+  //   sector_set_isdir(sector, true);
+  //   return true;
+  // } else return false;
+  /* old code end */
+  /* GXY's code begin */
+  struct dir_header h;
+  struct inode *inode;
+  bool success;
+
+  h.magic = DIR_HASH_MAGIC;
+  h.bucket_cnt = DIV_ROUND_UP (entry_cnt, DIR_BUCKET_SLOTS);
+  if (h.bucket_cnt < DIR_MIN_BUCKET_CNT)
+    h.bucket_cnt = DIR_MIN_BUCKET_CNT;
+  h.entry_cnt = 0;
+
+  /* Buckets are holes until entries are added to them. */
+  if (!inode_create (sector, bucket_ofs (h.bucket_cnt)))
+    return false;
+  sector_set_isdir (sector, true);
+  inode = inode_open (sector);
+  success = (inode != NULL
+             && inode_write_at (inode, &h, sizeof h, 0) == sizeof h);
+  inode_close (inode);
+  return success;
+  /* GXY's code end */
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -94,6 +153,147 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* GXY's code begin */
+/* Reads the header of DIR into *H.  Returns true if DIR is
+   hashed, false if it keeps a linear array of entries. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_HASH_MAGIC);
+}
+
+/* Returns the number of buckets of DIR, 0 if it keeps a linear
+   array of entries.  It is read from DIR every time, as another
+   opener may grow the directory; the directory lock must be
+   held. */
+static size_t
+dir_bucket_cnt (const struct dir *dir)
+{
+  struct dir_header h;
+
+  return read_header (dir, &h) ? h.bucket_cnt : 0;
+}
+
+/* Reads bucket B of hashed DIR into BUCKET.  Buckets past the
+   end of the directory read back as never used. */
+static void
+read_bucket (const struct dir *dir, size_t b,
+             struct dir_entry bucket[DIR_BUCKET_SLOTS])
+{
+  size_t size = DIR_BUCKET_SLOTS * sizeof *bucket;
+  off_t read = inode_read_at (dir->inode, bucket, size, bucket_ofs (b));
+  memset ((uint8_t *) bucket + read, 0, size - read);
+}
+
+/* Searches hashed DIR, which has BUCKET_CNT buckets, for NAME as
+   lookup() does.
+   If NAME is not found and FREEP is non-null, sets *FREEP to the
+   byte offset of the slot to add NAME at, or to -1 if every
+   bucket is full. */
+static bool
+hashed_lookup (const struct dir *dir, size_t bucket_cnt, const char *name,
+               struct dir_entry *ep, off_t *ofsp, off_t *freep)
+{
+  struct dir_entry bucket[DIR_BUCKET_SLOTS];
+  size_t first = hash_string (name) % bucket_cnt;
+  size_t i, j;
+
+  if (freep != NULL)
+    *freep = -1;
+  for (i = 0; i < bucket_cnt; i++)
+    {
+      size_t b = (first + i) % bucket_cnt;
+      read_bucket (dir, b, bucket);
+      for (j = 0; j < DIR_BUCKET_SLOTS; j++)
+        {
+          struct dir_entry *e = &bucket[j];
+          off_t ofs = bucket_ofs (b) + j * sizeof *e;
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = ofs;
+              return true;
+            }
+          if (!e->in_use && freep != NULL && *freep == -1)
+            *freep = ofs;
+          if (!e->in_use && e->inode_sector == 0)
+            return false;
+        }
+    }
+  return false;
+}
+/* GXY's code end */
+
+/* GXY's code begin */
+/* Adds DELTA to the number of entries in DIR, if it is hashed.
+   The count only decides when the buckets grow. */
+static void
+count_entries (struct dir *dir, int delta)
+{
+  struct dir_header h;
+
+  if (read_header (dir, &h))
+    {
+      h.entry_cnt += delta;
+      inode_write_at (dir->inode, &h, sizeof h, 0);
+    }
+}
+
+/* Moves the entries of hashed DIR from its OLD_CNT buckets into
+   twice as many, which also drops the slots of removed entries.
+   Every new bucket gets its sector before any entry moves, so
+   running out of disk space leaves DIR as it was.
+   Returns true if successful, false on failure. */
+static bool
+grow_buckets (struct dir *dir, size_t old_cnt)
+{
+  static const struct dir_entry empty[DIR_BUCKET_SLOTS];
+  const size_t size = sizeof empty;
+  size_t new_cnt = old_cnt * 2;
+  struct dir_entry *entries;
+  struct dir_header h;
+  size_t i;
+  off_t ofs;
+
+  entries = malloc (old_cnt * size);
+  if (entries == NULL || !read_header (dir, &h))
+    goto fail;
+  for (i = 0; i < old_cnt; i++)
+    read_bucket (dir, i, entries + i * DIR_BUCKET_SLOTS);
+
+  /* Allocate the buckets that are holes or past the end. */
+  for (i = 0; i < new_cnt; i++)
+    if ((i >= old_cnt
+         || !memcmp (entries + i * DIR_BUCKET_SLOTS, empty, size))
+        && inode_write_at (dir->inode, empty, size, bucket_ofs (i)) != size)
+      goto fail;
+
+  /* Clear the old buckets and put every entry back. */
+  for (i = 0; i < old_cnt; i++)
+    if (inode_write_at (dir->inode, empty, size, bucket_ofs (i)) != size)
+      goto fail;
+  h.bucket_cnt = new_cnt;
+  if (inode_write_at (dir->inode, &h, sizeof h, 0) != sizeof h)
+    goto fail;
+  for (i = 0; i < old_cnt * DIR_BUCKET_SLOTS; i++)
+    if (entries[i].in_use
+        && (hashed_lookup (dir, new_cnt, entries[i].name, NULL, NULL, &ofs)
+            || ofs == -1
+            || inode_write_at (dir->inode, &entries[i], sizeof entries[i],
+                               ofs) != sizeof entries[i]))
+      goto fail;
+  free (entries);
+  return true;
+
+ fail:
+  free (entries);
+  return false;
+}
+/* GXY's code end */
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -109,6 +309,12 @@ lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  /* GXY's code begin */
+  size_t buckets = dir_bucket_cnt (dir);
+  if (buckets > 0)
+    return hashed_lookup (dir, buckets, name, ep, ofsp, NULL);
+  /* GXY's code end */
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -131,15 +337,37 @@ dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
   struct dir_entry e;
+  /* GXY's code begin */
+  block_sector_t sector;
+  /* GXY's code end */
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  /* GXY's code begin */
+  inode_lock_shared (dir->inode);
+  if (dcache_lookup (inode_get_inumber (dir->inode), name, &sector))
+    {
+      *inode = sector != 0 ? inode_open (sector) : NULL;
+      inode_unlock_shared (dir->inode);
+      return *inode != NULL;
+    }
+  /* GXY's code end */
+
   if (lookup (dir, name, &e, NULL))
     *inode = inode_open (e.inode_sector);
   else
-    *inode = NULL;
+    {
+      /* GXY's code begin */
+      e.inode_sector = 0;
+      /* GXY's code end */
+      *inode = NULL;
+    }
 
+  /* GXY's code begin */
+  dcache_insert (inode_get_inumber (dir->inode), name, e.inode_sector);
+  inode_unlock_shared (dir->inode);
+  /* GXY's code end */
   return *inode != NULL;
 }
 
@@ -163,6 +391,28 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  /* GXY's code begin */
+  inode_lock_exclusive (dir->inode);
+  struct dir_header h;
+  if (read_header (dir, &h))
+    {
+      /* Check that NAME is not in use, finding a slot for it, with
+         more buckets if they are filling up. */
+      if (hashed_lookup (dir, h.bucket_cnt, name, NULL, NULL, &ofs))
+        goto done;
+      if (ofs == -1
+          || h.entry_cnt >= h.bucket_cnt * DIR_BUCKET_SLOTS * 3 / 4)
+        {
+          if (!grow_buckets (dir, h.bucket_cnt))
+            goto done;
+          hashed_lookup (dir, h.bucket_cnt * 2, name, NULL, NULL, &ofs);
+          if (ofs == -1)
+            goto done;
+        }
+      goto write_slot;
+    }
+  /* GXY's code end */
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
@@ -180,12 +430,23 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
       break;
 
   /* Write slot. */
+ write_slot:
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* GXY's code begin */
+  if (success)
+    {
+      count_entries (dir, 1);
+      dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+    }
+  /* GXY's code end */
 
  done:
+  /* GXY's code begin */
+  inode_unlock_exclusive (dir->inode);
+  /* GXY's code end */
   return success;
 }
 
@@ -203,6 +464,10 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  /* GXY's code begin */
+  inode_lock_exclusive (dir->inode);
+  /* GXY's code end */
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -212,7 +477,9 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
+  /* Erase directory entry.
+     GXY: inode_sector stays, so that a hashed directory tells the
+     slot from one that was never used. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
@@ -220,20 +487,59 @@ dir_remove (struct dir *dir, const char *name)
   /* Remove inode. */
   inode_remove (inode);
   success = true;
+  /* GXY's code begin */
+  count_entries (dir, -1);
+  dcache_insert (inode_get_inumber (dir->inode), name, 0);
+  dcache_invalidate_dir (e.inode_sector);
+  /* GXY's code end */
 
  done:
+  /* GXY's code begin */
+  inode_unlock_exclusive (dir->inode);
+  /* GXY's code end */
   inode_close (inode);
   return success;
 }
 
+/* GXY's code begin */
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
-bool
-dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+   contains no more entries.
+   The directory lock of DIR must be held. */
+static bool
+next_entry (struct dir *dir, char name[NAME_MAX + 1])
+/* GXY's code end */
 {
   struct dir_entry e;
 
+  /* GXY's code begin */
+  size_t buckets = dir_bucket_cnt (dir);
+  if (buckets > 0)
+    {
+      /* Walk the buckets, skipping their padding and the rest of a
+         bucket after a slot that was never used. */
+      if (dir->pos < bucket_ofs (0))
+        dir->pos = bucket_ofs (0);
+      while (dir->pos < bucket_ofs (buckets))
+        {
+          if (dir->pos % BLOCK_SECTOR_SIZE / sizeof e >= DIR_BUCKET_SLOTS
+              || inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e
+              || (!e.in_use && e.inode_sector == 0))
+            {
+              dir->pos = ROUND_UP (dir->pos + 1, BLOCK_SECTOR_SIZE);
+              continue;
+            }
+          dir->pos += sizeof e;
+          if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+            {
+              strlcpy (name, e.name, NAME_MAX + 1);
+              return true;
+            }
+        }
+      return false;
+    }
+  /* GXY's code end */
+
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
@@ -246,6 +552,27 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
   return false;
 }
 
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries. */
+bool
+dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  /* GXY's code begin */
+  /* NAME may be in user memory, which must not be touched with
+     the lock held: a page fault could need the file system. */
+  char entry_name[NAME_MAX + 1];
+  bool success;
+
+  inode_lock_shared (dir->inode);
+  success = next_entry (dir, entry_name);
+  inode_unlock_shared (dir->inode);
+  if (success)
+    strlcpy (name, entry_name, NAME_MAX + 1);
+  return success;
+  /* GXY's code end */
+}
+
 /* yy's code begin */
 /* Lookup a file or a subdir in directory and open. */
 struct file*
@@ -278,7 +605,7 @@ subfile_create(struct dir* dir, char* file_name, off_t initial_size) {
     return false;
   block_sector_t block_sector = 0;
   bool success = (dir != NULL
-                  && free_map_allocate(1, &block_sector)
+                  && free_map_allocate_near(inode_get_inumber(dir->inode), 1, &block_sector)
                   && inode_create(block_sector, initial_size)
                   && dir_add(dir, file_name, block_sector));
   if (!success && block_sector != 0)
@@ -294,7 +621,7 @@ subdir_create(struct dir* dir, char* dir_name) {
     return false;
   block_sector_t block_sector = 0;
   bool success = (dir != NULL
-                  && free_map_allocate(1, &block_sector)
+                  && free_map_allocate_near(inode_get_inumber(dir->inode), 1, &block_sector)
                   && dir_create(block_sector, 0)
                   && dir_add(dir, dir_name, block_sector));
   if (!success && block_sector != 0)
@@ -345,14 +672,16 @@ subdir_delete(struct dir* current_dir, char* dir_name) {
     struct dir* cpy_dir = dir_open(inode);
     char* buffer = malloc(NAME_MAX + 1);
     ASSERT(buffer != NULL)
-    if (dir_readdir(cpy_dir, buffer)) { // The directory contains other entries.
-      dir_close(cpy_dir);
-      free(buffer);
-      return false;
-    }
+    /* GXY's code begin */
+    // no entry may be added between the check and the removal
+    inode_lock_exclusive(inode);
+    bool success = !next_entry(cpy_dir, buffer) // The directory contains no other entries.
+                   && dir_remove(current_dir, dir_name);
+    inode_unlock_exclusive(inode);
     dir_close(cpy_dir);
     free(buffer);
-    return dir_remove(current_dir, dir_name);
+    return success;
+    /* GXY's code end */
   }
 }
 
@@ -2,6 +2,11 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+/* GXY's code begin */
+#include "devices/block.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+/* GXY's code end */
 /* yy's code begin */
 #include "filesys/directory.h"
 /* yy's code end */
@@ -16,8 +21,20 @@ struct file
     /* yy's code begin */
     struct dir* dir;
     /* yy's code end */
+
+    /* GXY's code begin */
+    off_t ra_pos;               /* End of the last read, to detect sequential access. */
+    off_t ra_end;               /* End of the range already queued for read-ahead. */
+    int ra_window;              /* Read-ahead window in sectors, 0 if random access. */
+    /* GXY's code end */
   };
 
+/* GXY's code begin */
+/* Read-ahead window bounds in sectors. */
+#define RA_MIN_WINDOW 4
+#define RA_MAX_WINDOW 32
+/* GXY's code end */
+
 void file_set_dir(struct file* file, const struct dir* dir) {
   file->dir = (struct dir *) dir;
 }
@@ -85,6 +102,36 @@ file_get_inode (struct file *file)
   return file->inode;
 }
 
+/* GXY's code begin */
+/* Updates FILE's read-ahead state after a read of bytes
+   [START, END).  The window doubles on every read that continues
+   the previous one and collapses on a seek, and the sectors past
+   END within the window that were not queued yet are handed to
+   the read-ahead thread. */
+static void
+file_read_ahead (struct file *file, off_t start, off_t end)
+{
+  if (start == file->ra_pos)
+    {
+      file->ra_window = file->ra_window == 0 ? RA_MIN_WINDOW : file->ra_window * 2;
+      if (file->ra_window > RA_MAX_WINDOW)
+        file->ra_window = RA_MAX_WINDOW;
+    }
+  else
+    file->ra_window = 0;
+  file->ra_pos = end;
+
+  if (file->ra_window == 0 || file->ra_end < end)
+    file->ra_end = end;
+  off_t target = end + file->ra_window * BLOCK_SECTOR_SIZE;
+  if (target > file->ra_end)
+    {
+      inode_prefetch (file->inode, file->ra_end, target);
+      file->ra_end = target;
+    }
+}
+/* GXY's code end */
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -94,6 +141,10 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  /* GXY's code begin */
+  if (bytes_read > 0)
+    file_read_ahead (file, file->pos, file->pos + bytes_read);
+  /* GXY's code end */
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -144,6 +195,56 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* GXY's code begin */
+/* Copies up to SIZE bytes from SRC to DST, each starting at its
+   current position, a page at a time through a kernel buffer.
+   Both positions advance by the number of bytes copied, which is
+   less than SIZE at the end of SRC or if DST cannot be written.
+   Returns -1 if either file is a directory, the two ranges
+   overlap in the same file, or no buffer is available. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  off_t copied = 0;
+  uint8_t *page;
+
+  if (inode_isdir (dst->inode) || inode_isdir (src->inode))
+    return -1;
+  if (dst->inode == src->inode
+      && src->pos < dst->pos + size && dst->pos < src->pos + size)
+    return -1;
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return -1;
+
+  while (size > 0)
+    {
+      /* Keep the source page-aligned, so most reads and writes
+         move whole sectors through the cache. */
+      off_t chunk = PGSIZE - src->pos % PGSIZE;
+      if (chunk > size)
+        chunk = size;
+
+      off_t bytes_read = file_read (src, page, chunk);
+      off_t bytes_written = bytes_read > 0 ? file_write (dst, page, bytes_read) : 0;
+      if (bytes_written < 0)
+        bytes_written = 0;
+      copied += bytes_written;
+      if (bytes_written < bytes_read)
+        {
+          /* Leave SRC just past what made it into DST. */
+          src->pos -= bytes_read - bytes_written;
+          break;
+        }
+      if (bytes_read < chunk)
+        break;
+      size -= chunk;
+    }
+  palloc_free_page (page);
+  return copied;
+}
+/* GXY's code end */
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -25,6 +25,9 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+/* GXY's code begin */
+off_t file_copy (struct file *dst, struct file *src, off_t size);
+/* GXY's code end */
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
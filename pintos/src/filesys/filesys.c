@@ -7,6 +7,7 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 
 /* yy's code begin */
 #include "threads/thread.h"
@@ -34,10 +35,15 @@ filesys_init (bool format)
 
   /* GXY's code begin */
   cache_init();
+  dcache_init();
   /* GXY's code end */
 
   if (format) 
     do_format ();
+  /* GXY's code begin */
+  else
+    inode_format = sector_get_format (ROOT_DIR_SECTOR);
+  /* GXY's code end */
 
   free_map_open ();
 }
@@ -47,6 +53,9 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  /* GXY's code begin */
+  inode_flush_all ();
+  /* GXY's code end */
   free_map_close ();
 
   /* GXY's code begin */
@@ -254,45 +263,45 @@ parse_path(const char* path, struct dir** parent_dir, char** name, bool* is_dir)
   else
     *parent_dir = dir_reopen(thread_current()->current_dir);
 
-  char* cpy_path = malloc(l + 1);
-  strlcpy(cpy_path, path, l + 1);
-
-  char* ptr;
-  char* result = strtok_r(cpy_path, "/", &ptr);
-  while (result != NULL) {
-    if (!check_name(result)) {
+  /* GXY's code begin */
+  // each component is copied into a buffer on the stack, instead of
+  // tokenizing a malloc'd copy of the whole path
+  char component[READDIR_MAX_LEN + 1];
+  const char *p = path + strspn(path, "/");
+  while (*p != '\0') {
+    size_t len = strcspn(p, "/");
+    if (len > READDIR_MAX_LEN) {
       *is_dir = false;
-      free(cpy_path);
-      return false;
+      goto fail;
     }
-    char* next = strtok_r(NULL, "/", &ptr);
-    if (next == NULL) {
-      struct dir *tmp = subfile_lookup(*parent_dir, result, true);
+    memcpy(component, p, len);
+    component[len] = '\0';
+    p += len;
+    p += strspn(p, "/");
+    if (*p == '\0') {
+      struct dir *tmp = subfile_lookup(*parent_dir, component, true);
       if (tmp != NULL && inode_isdir(dir_get_inode(tmp))) {
-        if (*is_dir) {
-          dir_close(tmp);
-          free(cpy_path);
-          return false;
-        } else {
-          dir_close(tmp);
-          *is_dir = true;
-        }
+        dir_close(tmp);
+        if (*is_dir)
+          goto fail;
+        *is_dir = true;
       }
-      strlcpy(*name, result, READDIR_MAX_LEN + 1);
-      break;      
+      strlcpy(*name, component, READDIR_MAX_LEN + 1);
     } else {
       struct dir* tmp = *parent_dir;
-      *parent_dir = subfile_lookup(*parent_dir, result, true);
+      *parent_dir = subfile_lookup(*parent_dir, component, true);
       dir_close(tmp);
-      if (*parent_dir == NULL){
-        free(cpy_path);
+      if (*parent_dir == NULL)
         return false;
-      }
     }
-    result = next;
   }
-  free(cpy_path);
   return true;
+
+ fail:
+  dir_close(*parent_dir);
+  *parent_dir = NULL;
+  return false;
+  /* GXY's code end */
 }
 
 /* yy's code end */
\ No newline at end of file
@@ -4,10 +4,42 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+/* GXY's code begin */
+#include <round.h>
+#include "threads/synch.h"
+/* GXY's code end */
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* GXY's code begin */
+// Bits of the free map stored in one sector of the free map file
+#define FREE_MAP_SECTOR_BITS (BLOCK_SECTOR_SIZE * 8)
+
+// Sectors of the free map file whose bits changed since they were last written.
+// They are written by free_map_flush, from the write-behind thread and on close,
+// so growing a file no longer rewrites the whole bitmap for every allocation.
+static struct bitmap *free_map_dirty;
+// Free sectors, and how many of them are reserved for delayed allocation:
+// only a holder of a reservation may allocate those
+static size_t free_cnt;
+static size_t reserved_cnt;
+// Protects free_map, free_map_dirty, free_map_file and the counts above
+static struct lock free_map_lock;
+// Held by free_map_flush, so that an older copy of a sector is never written
+// over a newer one, taken before free_map_lock
+static struct lock free_map_flush_lock;
+
+// Mark the free map file sectors holding bits [sector, sector + cnt) dirty
+static void
+free_map_mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / FREE_MAP_SECTOR_BITS;
+  size_t last = (sector + cnt - 1) / FREE_MAP_SECTOR_BITS;
+  bitmap_set_multiple (free_map_dirty, first, last - first + 1, true);
+}
+/* GXY's code end */
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
@@ -17,54 +49,214 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  /* GXY's code begin */
+  free_map_dirty = bitmap_create (DIV_ROUND_UP (bitmap_size (free_map),
+                                                FREE_MAP_SECTOR_BITS));
+  if (free_map_dirty == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
+  lock_init (&free_map_flush_lock);
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  /* GXY's code end */
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (0, cnt, sectorp);
+}
+
+/* GXY's code begin */
+/* Allocates CNT consecutive sectors as free_map_allocate() does,
+   but looks for them from sector GOAL on first, so that related
+   sectors end up close together. */
+bool
+free_map_allocate_near (block_sector_t goal, size_t cnt,
+                        block_sector_t *sectorp)
+{
+  return free_map_allocate_reserved (goal, cnt, 0, sectorp);
+}
+
+/* Allocates CNT consecutive sectors as free_map_allocate_near()
+   does, RESERVED of which were set aside by the caller with
+   free_map_reserve(), and are no longer reserved if successful.
+   The rest must come from sectors that are not reserved. */
+bool
+free_map_allocate_reserved (block_sector_t goal, size_t cnt,
+                            size_t reserved, block_sector_t *sectorp)
+{
+  block_sector_t sector = BITMAP_ERROR;
+
+  ASSERT (reserved <= cnt);
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved <= reserved_cnt);
+  if (goal > bitmap_size (free_map))
+    goal = 0;
+  if (free_cnt - (reserved_cnt - reserved) >= cnt)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      sector = bitmap_scan_and_flip (free_map, goal, cnt, false);
+      if (sector == BITMAP_ERROR && goal > 0)
+        sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      free_map_mark_dirty (sector, cnt);
+      free_cnt -= cnt;
+      reserved_cnt -= reserved;
+      *sectorp = sector;
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Sets CNT free sectors aside, so that allocating them later
+   with free_map_allocate_reserved() does not run out of space,
+   though they need not be consecutive.
+   Returns true if successful, false if not enough sectors are
+   free. */
+bool
+free_map_reserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  bool success = free_cnt - reserved_cnt >= cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Gives back CNT sectors set aside with free_map_reserve() that
+   were not allocated. */
+void
+free_map_unreserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (cnt <= reserved_cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
+}
+
+/* Counts the free sectors into *FREE_CNT, the runs of
+   consecutive free sectors into *RUN_CNT and the length of the
+   longest run into *LARGEST_RUN. */
+void
+free_map_stats (size_t *free_cnt, size_t *run_cnt, size_t *largest_run)
+{
+  size_t i, run = 0;
+
+  *free_cnt = *run_cnt = *largest_run = 0;
+  lock_acquire (&free_map_lock);
+  for (i = 0; i < bitmap_size (free_map); i++)
+    if (!bitmap_test (free_map, i))
+      {
+        if (run++ == 0)
+          ++*run_cnt;
+        ++*free_cnt;
+        if (run > *largest_run)
+          *largest_run = run;
+      }
+    else
+      run = 0;
+  lock_release (&free_map_lock);
+}
+/* GXY's code end */
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  /* GXY's code begin */
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  free_map_mark_dirty (sector, cnt);
+  free_cnt += cnt;
+  lock_release (&free_map_lock);
+  /* GXY's code end */
+}
+
+/* GXY's code begin */
+/* Writes the sectors of the free map changed since they were
+   last written to the free map file, if it is open. */
+void
+free_map_flush (void)
+{
+  // a sector of the bitmap is copied under free_map_lock and written after
+  // releasing it, writing the free map file may allocate from the free map
+  static uint8_t buf[BLOCK_SECTOR_SIZE];
+  size_t i;
+
+  lock_acquire (&free_map_flush_lock);
+  for (i = 0; i < bitmap_size (free_map_dirty); i++)
+    {
+      lock_acquire (&free_map_lock);
+      struct file *file = free_map_file;
+      size_t size = 0;
+      if (file != NULL && bitmap_test (free_map_dirty, i))
+        {
+          size_t start = i * FREE_MAP_SECTOR_BITS;
+          size_t cnt = bitmap_size (free_map) - start;
+          if (cnt > FREE_MAP_SECTOR_BITS)
+            cnt = FREE_MAP_SECTOR_BITS;
+          size = bitmap_copy_range (free_map, start, cnt, buf);
+          bitmap_reset (free_map_dirty, i);
+        }
+      lock_release (&free_map_lock);
+
+      if (size > 0
+          && file_write_at (file, buf, size, i * BLOCK_SECTOR_SIZE) != (off_t) size)
+        {
+          lock_acquire (&free_map_lock);
+          bitmap_mark (free_map_dirty, i);
+          lock_release (&free_map_lock);
+        }
+    }
+  lock_release (&free_map_flush_lock);
 }
+/* GXY's code end */
 
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void) 
 {
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* GXY's code begin */
+  struct file *file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  if (!bitmap_read (free_map, file))
     PANIC ("can't read free map");
+  lock_acquire (&free_map_lock);
+  free_map_file = file;
+  bitmap_set_all (free_map_dirty, false);
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  lock_release (&free_map_lock);
+  /* GXY's code end */
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
-  file_close (free_map_file);
+  /* GXY's code begin */
+  // the free map file's own delayed sectors are assigned first, so the
+  // bits they set are part of what is written, and it is closed without
+  // the locks, as closing it flushes it again
+  lock_acquire (&free_map_lock);
+  struct file *file = free_map_file;
+  lock_release (&free_map_lock);
+  inode_flush (file_get_inode (file));
+  free_map_flush ();
+  lock_acquire (&free_map_flush_lock);
+  lock_acquire (&free_map_lock);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
+  lock_release (&free_map_flush_lock);
+  file_close (file);
+  /* GXY's code end */
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -77,9 +269,21 @@ free_map_create (void)
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* GXY's code begin */
+  struct file *file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  // the new file is sparse, so writing it allocates its sectors from the
+  // free map: write it without free_map_lock, assign its delayed sectors,
+  // then write it again to record them. Every sector of the file is then
+  // allocated, and later writes never allocate.
+  if (!bitmap_write (free_map, file))
     PANIC ("can't write free map");
+  inode_flush (file_get_inode (file));
+  lock_acquire (&free_map_lock);
+  free_map_file = file;
+  bitmap_set_all (free_map_dirty, true);
+  lock_release (&free_map_lock);
+  free_map_flush ();
+  /* GXY's code end */
 }
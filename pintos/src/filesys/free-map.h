@@ -10,8 +10,15 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_flush (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_near (block_sector_t goal, size_t, block_sector_t *);
+bool free_map_allocate_reserved (block_sector_t goal, size_t, size_t reserved,
+                                 block_sector_t *);
+bool free_map_reserve (size_t);
+void free_map_unreserve (size_t);
 void free_map_release (block_sector_t, size_t);
+void free_map_stats (size_t *free_cnt, size_t *run_cnt, size_t *largest_run);
 
 #endif /* filesys/free-map.h */
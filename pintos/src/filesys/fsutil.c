@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,8 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -67,6 +70,29 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Reports how fragmented file ARGV[1] and the free space are. */
+void
+fsutil_frag (char **argv)
+{
+  const char *file_name = argv[1];
+  struct file *file;
+  struct inode *inode;
+  size_t free_cnt, run_cnt, largest_run;
+
+  file = filesys_open (file_name);
+  if (file == NULL)
+    PANIC ("%s: open failed", file_name);
+  inode = file_get_inode (file);
+  printf ("'%s': %zu sectors in %zu fragments\n", file_name,
+          (size_t) DIV_ROUND_UP (inode_length (inode), BLOCK_SECTOR_SIZE),
+          inode_fragments (inode));
+  file_close (file);
+
+  free_map_stats (&free_cnt, &run_cnt, &largest_run);
+  printf ("Free space: %zu sectors in %zu runs, largest %zu sectors\n",
+          free_cnt, run_cnt, largest_run);
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
    device into the Pintos file system. */
 void
@@ -1,5 +1,6 @@
 #include "filesys/inode.h"
 #include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
@@ -7,6 +8,9 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "filesys/cache.h"
 
 /* Identifies an inode. */
@@ -17,6 +21,40 @@
 #define INDIRECT_CNT 30
 #define DOUBLY_CNT 30
 #define INDIRECT_LENGTH ((int32_t) (BLOCK_SECTOR_SIZE / sizeof(block_sector_t)))
+
+// Format of newly created inodes, INODE_INDEXED unless -extents is given with -f
+enum inode_format inode_format = INODE_INDEXED;
+
+// A run of length sectors from start on disk, holding file sectors from logical on
+struct extent {
+  block_sector_t logical;
+  block_sector_t start;
+  uint32_t length;
+};
+
+// Points to a leaf block with the extents holding file sectors from logical on
+struct extent_index {
+  block_sector_t logical;
+  block_sector_t leaf;
+};
+
+// Contents of a new sector, and what a hole reads back as
+static char zeros[BLOCK_SECTOR_SIZE];
+
+// Sectors reserved past the end of a growing file, so its next growth stays contiguous
+#define PREALLOC_CNT 8
+
+// Sectors of appended data buffered per inode before sectors are assigned to them
+#define DELAYED_CNT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+// Free map sectors reserved for each delayed sector, its own and one for an index
+// or extent leaf block, plus one more per buffered run, so assigning them never runs out
+#define DELAYED_RESERVE_CNT 2
+
+// Extents kept in the inode itself (depth 0), or leaf blocks indexed by it (depth 1)
+#define EXTENT_INLINE_CNT 40
+#define EXTENT_INDEX_CNT 60
+#define EXTENT_LEAF_CNT ((BLOCK_SECTOR_SIZE - sizeof(uint32_t)) / sizeof(struct extent))
 /* GXY's code end */
 
 /* On-disk inode.
@@ -27,9 +65,17 @@ struct inode_disk
     // block_sector_t start;               /* First data sector. */
     /* old code end */
     /* GXY's code begin */
-    block_sector_t direct[DIRECT_CNT];
-    block_sector_t indirect[INDIRECT_CNT];
-    block_sector_t doubly[DOUBLY_CNT];
+    union {
+      // INODE_INDEXED
+      struct {
+        block_sector_t direct[DIRECT_CNT];
+        block_sector_t indirect[INDIRECT_CNT];
+        block_sector_t doubly[DOUBLY_CNT];
+      };
+      // INODE_EXTENT, extent_cnt entries of one of them depending on depth
+      struct extent extents[EXTENT_INLINE_CNT];
+      struct extent_index index[EXTENT_INDEX_CNT];
+    };
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
     /* yy's code begin */
@@ -39,8 +85,10 @@ struct inode_disk
     // uint32_t unused[125];               /* Not used. */
     /* old code end */
     /* GXY's code begin */
-    size_t allocated;
-    uint32_t unused[(BLOCK_SECTOR_SIZE - (DIRECT_CNT + INDIRECT_CNT + DOUBLY_CNT) * sizeof(block_sector_t) - sizeof(off_t) - sizeof(unsigned) - sizeof(size_t) - sizeof(bool)) / sizeof(uint32_t)];
+    uint8_t format;                     /* enum inode_format. */
+    uint8_t depth;                      /* Extent tree depth, 0 or 1. */
+    uint32_t extent_cnt;
+    uint32_t unused[(BLOCK_SECTOR_SIZE - (DIRECT_CNT + INDIRECT_CNT + DOUBLY_CNT) * sizeof(block_sector_t) - sizeof(off_t) - sizeof(unsigned) - sizeof(bool) - 2 * sizeof(uint8_t) - sizeof(uint32_t)) / sizeof(uint32_t)];
     /* GXY's code end */
   };
 
@@ -48,6 +96,13 @@ struct inode_disk
 struct indirect_disk {
   block_sector_t sectors[INDIRECT_LENGTH];
 };
+
+// Leaf block of the extent tree
+struct extent_leaf {
+  uint32_t cnt;
+  struct extent extents[EXTENT_LEAF_CNT];
+  uint8_t unused[BLOCK_SECTOR_SIZE - sizeof(uint32_t) - EXTENT_LEAF_CNT * sizeof(struct extent)];
+};
 /* GXY's code end */
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -58,17 +113,51 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* GXY's code begin */
+/* Key of an inode in open_inodes, so that a lookup does not need
+   a whole `struct inode'. */
+struct inode_key
+  {
+    struct hash_elem elem;              /* Element in open_inodes. */
+    block_sector_t sector;              /* Sector number of disk location. */
+  };
+/* GXY's code end */
+
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    /* old code begin */
+    // struct list_elem elem;              /* Element in inode list. */
+    /* old code end */
+    /* GXY's code begin */
+    struct inode_key key;               /* Element in open_inodes. */
+    struct lock lock;                   /* Protects data and the fields below. */
+    struct rwlock dir_lock;             /* Orders operations on a directory. */
+    /* GXY's code end */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    int open_cnt;                       /* Number of openers, protected by open_inodes_lock. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    /* GXY's code begin */
+    struct extent hint;                 /* Last extent looked up. */
+    block_sector_t goal;                /* Where to allocate next, 0 if unknown. */
+    block_sector_t prealloc_start;      /* Reserved sectors for growth. */
+    size_t prealloc_cnt;
+    uint8_t *delayed;                   /* Page buffering unallocated sectors. */
+    size_t delayed_start;               /* First file sector in it. */
+    size_t delayed_cnt;                 /* Number of file sectors in it. */
+    size_t reserved_cnt;                /* Free map sectors reserved for them. */
+    bool flushing;                      /* Assigning sectors to them. */
+    /* GXY's code end */
   };
 
+/* GXY's code begin */
+static bool inode_allocate_near(struct inode *, size_t cnt, size_t need, block_sector_t *sector);
+static size_t inode_allocate_run(struct inode *, size_t cnt, block_sector_t *sector);
+static void inode_release_prealloc(struct inode *);
+/* GXY's code end */
+
 /* yy's code begin */
 int inode_get_opencnt(const struct inode * inode){
   return inode->open_cnt;
@@ -91,15 +180,189 @@ void sector_set_isdir(block_sector_t sector, bool is_dir) {
 /* yy's code end */
 /* GXY's code begin */
 
-// Get the sector based on inode on disk and the position
-static block_sector_t inode_member(const struct inode *inode_, off_t pos) {
+// Format of the inode at sector, used to keep the format of a mounted file system
+enum inode_format sector_get_format(block_sector_t sector) {
+  uint8_t format;
+  cache_read_at(sector, &format, offsetof(struct inode_disk, format), sizeof(format));
+  return format;
+}
+
+// Find the extent holding file sector pos in extents[0, cnt), NULL if pos is in a hole
+static const struct extent *extent_search(const struct extent *extents, size_t cnt, size_t pos) {
+  if (cnt == 0) return NULL;
+  size_t lo = 0, hi = cnt;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (extents[mid].logical <= pos) lo = mid;
+    else hi = mid;
+  }
+  if (pos < extents[lo].logical || pos - extents[lo].logical >= extents[lo].length) return NULL;
+  return extents + lo;
+}
+
+// Find the leaf of a depth 1 extent tree covering file sector pos
+static size_t extent_index_search(const struct inode_disk *inode, size_t pos) {
+  size_t lo = 0, hi = inode->extent_cnt;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (inode->index[mid].logical <= pos) lo = mid;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Get the sector at position pos of an extent-based inode, 0 if it is a hole.
+// Sequential access mostly stays in the last extent found, which is checked first.
+static block_sector_t extent_member(struct inode *inode_, size_t pos) {
+  struct inode_disk *inode = &inode_->data;
+  struct extent *hint = &inode_->hint;
+
+  if (pos - hint->logical >= hint->length) {
+    const struct extent *found;
+    struct extent_leaf leaf;
+    if (inode->depth == 0) {
+      found = extent_search(inode->extents, inode->extent_cnt, pos);
+    } else {
+      cache_read(inode->index[extent_index_search(inode, pos)].leaf, &leaf);
+      found = extent_search(leaf.extents, leaf.cnt, pos);
+    }
+    if (found == NULL) return 0;
+    *hint = *found;
+  }
+  return hint->start + (pos - hint->logical);
+}
+
+// Add the run [start, start + length) for file sectors from logical on to the sorted extents[0, *cnt),
+// merging it into the extent before if they are adjacent both in the file and on disk
+// returns false iff there is no room for it
+static bool extents_insert(struct extent *extents, uint32_t *cnt, size_t max,
+                           block_sector_t logical, block_sector_t start, size_t length) {
+  size_t i = *cnt;
+  while (i > 0 && extents[i - 1].logical > logical) i--;
+  if (i > 0) {
+    struct extent *prev = &extents[i - 1];
+    if (prev->logical + prev->length == logical && prev->start + prev->length == start) {
+      prev->length += length;
+      return true;
+    }
+  }
+  if (*cnt == max) return false;
+  memmove(extents + i + 1, extents + i, (*cnt - i) * sizeof(struct extent));
+  extents[i].logical = logical;
+  extents[i].start = start;
+  extents[i].length = length;
+  (*cnt)++;
+  return true;
+}
+
+// Start a new leaf block of inode holding extents[0, cnt), returns false iff no sector is free
+static bool extent_new_leaf(struct inode *inode, block_sector_t *sector, const struct extent *extents, size_t cnt) {
+  if (!inode_allocate_near(inode, 1, 1, sector)) return false;
+  struct extent_leaf leaf;
+  memset(&leaf, 0, sizeof leaf);
+  leaf.cnt = cnt;
+  memcpy(leaf.extents, extents, cnt * sizeof(struct extent));
+  cache_write(*sector, &leaf);
+  return true;
+}
+
+// Map the run [start, start + length) as file sectors from logical on in an extent-based inode.
+// Inline extents move to a leaf block once they are full, and a full leaf is split in two,
+// or left as it is when the run goes past its last extent.
+// returns false iff the extent tree is full
+static bool extent_insert(struct inode *inode_, block_sector_t logical, block_sector_t start, size_t length) {
+  struct inode_disk *inode = &inode_->data;
+
+  if (inode->depth == 0) {
+    if (extents_insert(inode->extents, &inode->extent_cnt, EXTENT_INLINE_CNT, logical, start, length))
+      return true;
+    block_sector_t leaf_sector;
+    if (!extent_new_leaf(inode_, &leaf_sector, inode->extents, inode->extent_cnt)) return false;
+    inode->depth = 1;
+    inode->extent_cnt = 1;
+    inode->index[0].logical = 0;
+    inode->index[0].leaf = leaf_sector;
+  }
+
+  size_t i = extent_index_search(inode, logical);
+  struct extent_index *index = &inode->index[i];
+  struct extent_leaf leaf;
+  cache_read(index->leaf, &leaf);
+  if (extents_insert(leaf.extents, &leaf.cnt, EXTENT_LEAF_CNT, logical, start, length)) {
+    cache_write(index->leaf, &leaf);
+    return true;
+  }
+  if (inode->extent_cnt == EXTENT_INDEX_CNT) return false;
+  size_t half = logical > leaf.extents[leaf.cnt - 1].logical ? leaf.cnt : leaf.cnt / 2;
+  block_sector_t upper_logical = half < leaf.cnt ? leaf.extents[half].logical : logical;
+  block_sector_t upper_leaf;
+  if (!extent_new_leaf(inode_, &upper_leaf, leaf.extents + half, leaf.cnt - half)) return false;
+  if (half < leaf.cnt) {
+    leaf.cnt = half;
+    cache_write(index->leaf, &leaf);
+  }
+  memmove(index + 2, index + 1, (inode->extent_cnt - i - 1) * sizeof(struct extent_index));
+  index[1].logical = upper_logical;
+  index[1].leaf = upper_leaf;
+  inode->extent_cnt++;
+  return extent_insert(inode_, logical, start, length);
+}
+
+// Release the sectors for file sectors from keep on in extents[0, *cnt)
+static void extents_truncate(struct extent *extents, uint32_t *cnt, size_t keep) {
+  while (*cnt > 0) {
+    struct extent *last = &extents[*cnt - 1];
+    if (last->logical >= keep) {
+      free_map_release(last->start, last->length);
+      (*cnt)--;
+    } else {
+      size_t end = last->logical + last->length;
+      if (end > keep) {
+        free_map_release(last->start + (keep - last->logical), end - keep);
+        last->length = keep - last->logical;
+      }
+      return;
+    }
+  }
+}
+
+// Release the sectors for file sectors from keep on in an extent-based inode,
+// with the leaf blocks left empty
+static void extent_truncate(struct inode *inode_, size_t keep) {
+  struct inode_disk *inode = &inode_->data;
+
+  inode_->hint.length = 0;
+  if (inode->depth == 0) {
+    extents_truncate(inode->extents, &inode->extent_cnt, keep);
+    return;
+  }
+  while (inode->extent_cnt > 0) {
+    struct extent_index *last = &inode->index[inode->extent_cnt - 1];
+    struct extent_leaf leaf;
+    cache_read(last->leaf, &leaf);
+    extents_truncate(leaf.extents, &leaf.cnt, keep);
+    if (leaf.cnt > 0) {
+      cache_write(last->leaf, &leaf);
+      return;
+    }
+    free_map_release(last->leaf, 1);
+    inode->extent_cnt--;
+  }
+  inode->depth = 0;
+}
+
+// Get the sector based on inode on disk and the position, 0 if it is a hole
+static block_sector_t inode_member(struct inode *inode_, off_t pos) {
   const struct inode_disk *inode = &inode_->data;
 
+  if (inode->format == INODE_EXTENT) return extent_member(inode_, pos);
+
   if (pos < DIRECT_CNT) return inode->direct[pos];
   pos -= DIRECT_CNT;
   if (pos < INDIRECT_CNT * INDIRECT_LENGTH) {
     int indirect_pos = pos / INDIRECT_LENGTH;
     block_sector_t ret;
+    if (inode->indirect[indirect_pos] == 0) return 0;
     cache_read_at(inode->indirect[indirect_pos], &ret, (pos % INDIRECT_LENGTH) * sizeof(block_sector_t), sizeof(block_sector_t));
     return ret;
   }
@@ -109,7 +372,9 @@ static block_sector_t inode_member(const struct inode *inode_, off_t pos) {
     int indirect_pos = pos % (INDIRECT_LENGTH * INDIRECT_LENGTH) / INDIRECT_LENGTH;
     int final_pos = pos % INDIRECT_LENGTH;
     block_sector_t indirect, ret;
+    if (inode->doubly[doubly_pos] == 0) return 0;
     cache_read_at(inode->doubly[doubly_pos], &indirect, indirect_pos * sizeof(block_sector_t), sizeof(block_sector_t));
+    if (indirect == 0) return 0;
     cache_read_at(indirect, &ret, final_pos * sizeof(block_sector_t), sizeof(block_sector_t));
     // struct indirect_disk doubly, indirect;
     // cache_read(inode->doubly[doubly_pos], &doubly);
@@ -119,211 +384,262 @@ static block_sector_t inode_member(const struct inode *inode_, off_t pos) {
   ASSERT(false && "too large offset");
 }
 
-// Release sectors in [start, start + cnt)
-static void sectors_release_at(block_sector_t *start, size_t cnt) {
-  for (block_sector_t *i = start; i < start + cnt; i++)
-    free_map_release(*i, 1);
-}
-
-// Allocate cnt sectors, saving them in [start, start + cnt)
-// returns true iff success
-static bool sectors_allocate_at(block_sector_t *start, size_t cnt) {
-  block_sector_t *cur_start = start;
-  size_t single = cnt;
-  while (true) {
-    if (free_map_allocate(single, cur_start)) {
-      static char zeros[BLOCK_SECTOR_SIZE];
-      for (size_t i = 0; i < single; i++)
-        cache_write(cur_start[i] = cur_start[0] + i, zeros);
-      cur_start += single;
-      size_t delta = start + cnt - cur_start;
-      if (delta == 0) return true;
-      if (single > delta) single = delta;
-    } else {
-      single >>= 1;
-      if (single == 0) {
-        sectors_release_at(start, cur_start - start);
-        return false;
-      }
-    }
-  }
+// Allocate cnt sectors near the goal of inode, the first need of them from the
+// sectors reserved for its delayed sectors while they are assigned sectors
+static bool inode_allocate_near(struct inode *inode, size_t cnt, size_t need, block_sector_t *sector) {
+  size_t reserved = !inode->flushing ? 0 : need < inode->reserved_cnt ? need : inode->reserved_cnt;
+  if (!free_map_allocate_reserved(inode->goal, cnt, reserved, sector)) return false;
+  inode->reserved_cnt -= reserved;
+  return true;
 }
 
-// Release sector number [inode->allcated, allocated) in inod
-// used when allocation failed
-static void inode_undo_allocate(struct inode *inode_, size_t allocated) {
-  struct inode_disk *inode = &inode_->data;
-  block_sector_t sector = inode_->sector;
+// Allocate a run of at most cnt sectors for inode, stores the first into *sector
+// and returns its length, 0 iff no sector is free.
+// Runs come from the preallocation window if there is one, otherwise from the
+// free map near the goal, which is right after the last sector of the file;
+// a new window is reserved past the run when there is room for it.
+static size_t inode_allocate_run(struct inode *inode, size_t cnt, block_sector_t *sector) {
+  if (inode->goal == 0) {
+    size_t last = bytes_to_sectors(inode->data.length);
+    block_sector_t last_sector = last > 0 ? inode_member(inode, last - 1) : 0;
+    inode->goal = last_sector != 0 ? last_sector + 1 : inode->sector + 1;
+  }
 
-  if (inode->allocated < DIRECT_CNT) {
-    size_t direct_cnt = allocated < DIRECT_CNT ? allocated : DIRECT_CNT;
-    sectors_release_at(inode->direct + inode->allocated, direct_cnt - inode->allocated);
+  size_t n = cnt;
+  if (inode->prealloc_cnt > 0) {
+    if (n > inode->prealloc_cnt) n = inode->prealloc_cnt;
+    *sector = inode->prealloc_start;
+    inode->prealloc_start += n;
+    inode->prealloc_cnt -= n;
+  } else if (inode_allocate_near(inode, cnt + PREALLOC_CNT, cnt, sector)) {
+    inode->prealloc_start = *sector + cnt;
+    inode->prealloc_cnt = PREALLOC_CNT;
+  } else {
+    while (n > 0 && !inode_allocate_near(inode, n, n, sector))
+      n >>= 1;
+    if (n == 0) return 0;
   }
+  inode->goal = *sector + n;
+  return n;
+}
 
-  for (block_sector_t *indirect = inode->indirect; indirect < inode->indirect + INDIRECT_CNT; indirect++) {
-    size_t start = DIRECT_CNT + (indirect - inode->indirect) * INDIRECT_LENGTH;
-    size_t end = start + INDIRECT_LENGTH;
-    if (inode->allocated >= end) continue;
-    if (allocated <= start) break;
-    size_t from = inode->allocated < start ? 0 : inode->allocated - start;
-    size_t to = allocated - start;
-    if (to > INDIRECT_LENGTH) to = INDIRECT_LENGTH;
-    struct indirect_disk indirect_d;
-    cache_read_at(*indirect, indirect_d.sectors + from, from * sizeof(block_sector_t), (to - from) * sizeof(block_sector_t));
-    sectors_release_at(indirect_d.sectors + from, to - from);
-    if (inode->allocated <= start) sectors_release_at(indirect, 1);
+// Give the unused preallocation window of inode back to the free map
+static void inode_release_prealloc(struct inode *inode) {
+  if (inode->prealloc_cnt > 0) {
+    free_map_release(inode->prealloc_start, inode->prealloc_cnt);
+    inode->prealloc_cnt = 0;
   }
+}
 
-  for (block_sector_t *doubly = inode->doubly; doubly < inode->doubly + DOUBLY_CNT; doubly++) {
-    size_t doubly_start = DIRECT_CNT + INDIRECT_CNT * INDIRECT_LENGTH + (doubly - inode->doubly) * INDIRECT_LENGTH * INDIRECT_LENGTH;
-    size_t doubly_end = doubly_start + INDIRECT_LENGTH * INDIRECT_LENGTH;
-    if (inode->allocated >= doubly_end) continue;
-    if (allocated <= doubly_start) break;
-    struct indirect_disk doubly_d;
-    cache_read(*doubly, &doubly_d);
-    for (block_sector_t *indirect = doubly_d.sectors; indirect < doubly_d.sectors + INDIRECT_LENGTH; indirect++) {
-      size_t start = doubly_start + (indirect - doubly_d.sectors) * INDIRECT_LENGTH;
-      size_t end = start + INDIRECT_LENGTH;
-      if (inode->allocated >= end) continue;
-      if (allocated <= start) break;
-      size_t from = inode->allocated < start ? 0 : inode->allocated - start;
-      size_t to = allocated - start;
-      if (to > INDIRECT_LENGTH) to = INDIRECT_LENGTH;
-      struct indirect_disk indirect_d;
-      cache_read_at(*indirect, indirect_d.sectors + from, from * sizeof(block_sector_t), (to - from) * sizeof(block_sector_t));
-      sectors_release_at(indirect_d.sectors + from, to - from);
-      if (inode->allocated <= start) sectors_release_at(indirect, 1);
-    }
-    if (inode->allocated <= doubly_start) sectors_release_at(doubly, 1);
+// Number of runs of contiguous sectors holding the data of inode, holes excluded
+size_t inode_fragments(struct inode *inode) {
+  size_t cnt = 0;
+  block_sector_t prev = 0;
+  lock_acquire(&inode->lock);
+  for (size_t pos = 0; pos < bytes_to_sectors(inode->data.length); pos++) {
+    block_sector_t sector = inode_member(inode, pos);
+    if (sector != 0 && (prev == 0 || sector != prev + 1)) cnt++;
+    prev = sector;
   }
+  lock_release(&inode->lock);
+  return cnt;
+}
 
-  cache_write(sector, inode);
+// Make sure *slot, kept at byte ofs of sector table, points to an index block,
+// allocating a zeroed one (all holes) if it does not yet
+// returns false iff no sector is free
+static bool index_ensure(struct inode *inode, block_sector_t *slot, block_sector_t table, size_t ofs) {
+  if (*slot != 0) return true;
+  block_sector_t sector;
+  if (inode_allocate_run(inode, 1, &sector) == 0) return false;
+  cache_write(sector, zeros);
+  *slot = sector;
+  cache_write_at(table, slot, ofs, sizeof(block_sector_t));
+  return true;
 }
 
-// If not enough yet, allocate more to ensure inode to have at least target sectors
-// returns true iff success
-static bool inode_ensure_sectors(struct inode *inode_, size_t target) {
+// Point file sector pos of an indexed inode to sector, allocating index blocks on the way
+// returns false iff no sector is free for them
+static bool indexed_link(struct inode *inode_, size_t pos, block_sector_t sector) {
   struct inode_disk *inode = &inode_->data;
-  block_sector_t sector = inode_->sector;
-
-  if (inode->allocated >= target) return true;
+  block_sector_t table;
 
-  size_t allocated = inode->allocated;
-
-  if (inode->allocated < DIRECT_CNT) {
-    size_t direct_cnt = target < DIRECT_CNT ? target : DIRECT_CNT;
-    if (!sectors_allocate_at(inode->direct + inode->allocated, direct_cnt - inode->allocated))
+  if (pos < DIRECT_CNT) {
+    inode->direct[pos] = sector;
+    cache_write_at(inode_->sector, &sector, offsetof(struct inode_disk, direct) + pos * sizeof(block_sector_t), sizeof(block_sector_t));
+    return true;
+  }
+  pos -= DIRECT_CNT;
+  if (pos < INDIRECT_CNT * INDIRECT_LENGTH) {
+    size_t indirect_pos = pos / INDIRECT_LENGTH;
+    if (!index_ensure(inode_, &inode->indirect[indirect_pos], inode_->sector,
+                      offsetof(struct inode_disk, indirect) + indirect_pos * sizeof(block_sector_t)))
+      return false;
+    table = inode->indirect[indirect_pos];
+  } else {
+    pos -= INDIRECT_CNT * INDIRECT_LENGTH;
+    ASSERT(pos < DOUBLY_CNT * INDIRECT_LENGTH * INDIRECT_LENGTH);
+    size_t doubly_pos = pos / INDIRECT_LENGTH / INDIRECT_LENGTH;
+    size_t indirect_pos = pos % (INDIRECT_LENGTH * INDIRECT_LENGTH) / INDIRECT_LENGTH;
+    if (!index_ensure(inode_, &inode->doubly[doubly_pos], inode_->sector,
+                      offsetof(struct inode_disk, doubly) + doubly_pos * sizeof(block_sector_t)))
+      return false;
+    cache_read_at(inode->doubly[doubly_pos], &table, indirect_pos * sizeof(block_sector_t), sizeof(block_sector_t));
+    if (!index_ensure(inode_, &table, inode->doubly[doubly_pos], indirect_pos * sizeof(block_sector_t)))
       return false;
-    allocated = direct_cnt;
   }
+  cache_write_at(table, &sector, (pos % INDIRECT_LENGTH) * sizeof(block_sector_t), sizeof(block_sector_t));
+  return true;
+}
 
-  if (allocated == target) {
-    inode->allocated = target;
-    cache_write(sector, inode);
-    return true;
+// Point file sectors from logical on of inode to the run [start, start + cnt)
+// returns how many of them were linked before the index ran out of room or sectors
+static size_t inode_link_run(struct inode *inode, size_t logical, block_sector_t start, size_t cnt) {
+  if (inode->data.format == INODE_EXTENT) {
+    bool linked = extent_insert(inode, logical, start, cnt);
+    cache_write(inode->sector, &inode->data);
+    return linked ? cnt : 0;
   }
+  size_t i;
+  for (i = 0; i < cnt; i++)
+    if (!indexed_link(inode, logical + i, start + i)) break;
+  return i;
+}
 
-  for (block_sector_t *indirect = inode->indirect; indirect < inode->indirect + INDIRECT_CNT && allocated < target; indirect++) {
-    size_t start = DIRECT_CNT + (indirect - inode->indirect) * INDIRECT_LENGTH;
-    size_t end = start + INDIRECT_LENGTH;
-    if (inode->allocated >= end) continue;
-    struct indirect_disk indirect_d;
-    if (inode->allocated <= start) {
-      if (!sectors_allocate_at(indirect, 1)) {
-        inode_undo_allocate(inode_, allocated);
-        return false;
-      }
-    }
-    size_t from = inode->allocated < start ? 0 : inode->allocated - start;
-    size_t to = target - start;
-    if (to > INDIRECT_LENGTH) to = INDIRECT_LENGTH;
-    if (sectors_allocate_at(indirect_d.sectors + from, to - from)) {
-      cache_write_at(*indirect, indirect_d.sectors + from, from * sizeof(block_sector_t), (to - from) * sizeof(block_sector_t));
-      allocated = start + to;
-    } else {
-      if (inode->allocated <= start) sectors_release_at(indirect, 1);
-      inode_undo_allocate(inode_, allocated);
-      return false;
-    }
+// Get the sector at position pos of inode, allocating it if it is a hole.
+// A new sector gets the sector of data, or zeros if data is NULL, before it is linked,
+// so no reader sees what it held before; *filled tells whether data went into it.
+// returns 0 iff no sector is free
+static block_sector_t inode_map(struct inode *inode, size_t pos, const void *data, bool *filled) {
+  block_sector_t sector = inode_member(inode, pos);
+  *filled = false;
+  if (sector != 0) return sector;
+
+  if (inode_allocate_run(inode, 1, &sector) == 0) return 0;
+  cache_write(sector, data != NULL ? data : zeros);
+  *filled = data != NULL;
+  if (inode_link_run(inode, pos, sector, 1) == 0) {
+    free_map_release(sector, 1);
+    return 0;
   }
+  return sector;
+}
 
-  if (allocated == target) {
-    inode->allocated = target;
-    cache_write(sector, inode);
+// Whether the index of inode can link DELAYED_CNT more runs from file sector pos on.
+// Index blocks come out of the reserved space, so only a full extent tree runs out of room:
+// a leaf can be split while the index has a free slot, leaving at least half a leaf for them.
+static bool inode_index_room(struct inode *inode, size_t pos) {
+  const struct inode_disk *data = &inode->data;
+  if (data->format != INODE_EXTENT || data->depth == 0 || data->extent_cnt < EXTENT_INDEX_CNT)
     return true;
+  struct extent_leaf leaf;
+  cache_read(data->index[extent_index_search(data, pos)].leaf, &leaf);
+  return leaf.cnt + DELAYED_CNT <= EXTENT_LEAF_CNT;
+}
+
+// Assign sectors to the delayed sectors of inode, in as few runs as the free map gives,
+// and move their data into the cache. The space reserved for them is used up or given back.
+// returns false iff the index of inode is full, which inode_delay checks before buffering,
+// the sectors left without one read back as zeros
+static bool inode_flush_delayed(struct inode *inode) {
+  size_t done = 0;
+  inode->flushing = true;
+  while (done < inode->delayed_cnt) {
+    block_sector_t start;
+    size_t n = inode_allocate_run(inode, inode->delayed_cnt - done, &start);
+    if (n == 0) break;
+    for (size_t i = 0; i < n; i++)
+      cache_write(start + i, inode->delayed + (done + i) * BLOCK_SECTOR_SIZE);
+    size_t linked = inode_link_run(inode, inode->delayed_start + done, start, n);
+    if (linked < n) free_map_release(start + linked, n - linked);
+    done += linked;
+    if (linked < n) break;
+  }
+  bool success = done == inode->delayed_cnt;
+  inode->flushing = false;
+  free_map_unreserve(inode->reserved_cnt);
+  inode->reserved_cnt = 0;
+  inode->delayed_cnt = 0;
+  return success;
+}
+
+// Get where data for file sector pos of inode is kept until a sector is assigned to it,
+// which are consecutive holes written in order, at most DELAYED_CNT of them at a time.
+// Space for them is reserved in the free map, so they never fail to get sectors later.
+// returns NULL if pos already has a sector, or it cannot be buffered
+static uint8_t *inode_delay(struct inode *inode, size_t pos) {
+  if (inode->delayed_cnt > 0 && pos - inode->delayed_start < inode->delayed_cnt)
+    return inode->delayed + (pos - inode->delayed_start) * BLOCK_SECTOR_SIZE;
+  if (inode_member(inode, pos) != 0) return NULL;
+
+  if (inode->delayed_cnt > 0
+      && (pos != inode->delayed_start + inode->delayed_cnt || inode->delayed_cnt == DELAYED_CNT)
+      && !inode_flush_delayed(inode))
+    return NULL;
+  if (inode->delayed == NULL && (inode->delayed = palloc_get_page(0)) == NULL)
+    return NULL;
+  if (inode->delayed_cnt == 0 && !inode_index_room(inode, pos)) return NULL;
+  size_t reserve = DELAYED_RESERVE_CNT + (inode->delayed_cnt == 0);
+  if (!free_map_reserve(reserve)) return NULL;
+  inode->reserved_cnt += reserve;
+  if (inode->delayed_cnt == 0) inode->delayed_start = pos;
+  uint8_t *data = inode->delayed + inode->delayed_cnt++ * BLOCK_SECTOR_SIZE;
+  memset(data, 0, BLOCK_SECTOR_SIZE);
+  return data;
+}
+
+// Get the buffered data of file sector pos of inode, NULL if it is not delayed
+static const uint8_t *inode_delayed_data(const struct inode *inode, size_t pos) {
+  if (inode->delayed_cnt > 0 && pos - inode->delayed_start < inode->delayed_cnt)
+    return inode->delayed + (pos - inode->delayed_start) * BLOCK_SECTOR_SIZE;
+  return NULL;
+}
+
+// Release the allocated sectors in [start, start + cnt), skipping holes
+static void sectors_release(const block_sector_t *start, size_t cnt) {
+  for (const block_sector_t *i = start; i < start + cnt; i++)
+    if (*i != 0) free_map_release(*i, 1);
+}
+
+// Release the sectors of an indexed inode together with its index blocks
+static void indexed_release(struct inode_disk *inode) {
+  sectors_release(inode->direct, DIRECT_CNT);
+
+  for (block_sector_t *indirect = inode->indirect; indirect < inode->indirect + INDIRECT_CNT; indirect++) {
+    if (*indirect == 0) continue;
+    struct indirect_disk indirect_d;
+    cache_read(*indirect, &indirect_d);
+    sectors_release(indirect_d.sectors, INDIRECT_LENGTH);
+    free_map_release(*indirect, 1);
   }
 
-  for (block_sector_t *doubly = inode->doubly; doubly < inode->doubly + DOUBLY_CNT && allocated < target; doubly++) {
-    size_t doubly_start = DIRECT_CNT + INDIRECT_CNT * INDIRECT_LENGTH + (doubly - inode->doubly) * INDIRECT_LENGTH * INDIRECT_LENGTH;
-    size_t doubly_end = doubly_start + INDIRECT_LENGTH * INDIRECT_LENGTH;
-    if (inode->allocated >= doubly_end) continue;
+  for (block_sector_t *doubly = inode->doubly; doubly < inode->doubly + DOUBLY_CNT; doubly++) {
+    if (*doubly == 0) continue;
     struct indirect_disk doubly_d;
-    if (inode->allocated <= doubly_start) {
-      if (!sectors_allocate_at(doubly, 1)) {
-        inode_undo_allocate(inode_, allocated);
-        return false;
-      }
-    } else {
-      cache_read(*doubly, &doubly_d);
-    }
-    for (block_sector_t *indirect = doubly_d.sectors; indirect < doubly_d.sectors + INDIRECT_LENGTH && allocated < target; indirect++) {
-      size_t start = doubly_start + (indirect - doubly_d.sectors) * INDIRECT_LENGTH;
-      size_t end = start + INDIRECT_LENGTH;
-      if (inode->allocated >= end) continue;
+    cache_read(*doubly, &doubly_d);
+    for (block_sector_t *indirect = doubly_d.sectors; indirect < doubly_d.sectors + INDIRECT_LENGTH; indirect++) {
+      if (*indirect == 0) continue;
       struct indirect_disk indirect_d;
-      if (inode->allocated <= start) {
-        if (!sectors_allocate_at(indirect, 1)) {
-          if (inode->allocated <= doubly_start) sectors_release_at(doubly, 1);
-          inode_undo_allocate(inode_, allocated);
-          return false;
-        }
-      }
-      size_t from = inode->allocated < start ? 0 : inode->allocated - start;
-      size_t to = target - start;
-      if (to > INDIRECT_LENGTH) to = INDIRECT_LENGTH;
-      if (sectors_allocate_at(indirect_d.sectors + from, to - from)) {
-        cache_write_at(*indirect, indirect_d.sectors + from, from * sizeof(block_sector_t), (to - from) * sizeof(block_sector_t));
-        allocated = start + to;
-      } else {
-        if (inode->allocated <= doubly_start) sectors_release_at(doubly, 1);
-        if (inode->allocated <= start) sectors_allocate_at(indirect, 1);
-        inode_undo_allocate(inode_, allocated);
-        return false;
-      }
+      cache_read(*indirect, &indirect_d);
+      sectors_release(indirect_d.sectors, INDIRECT_LENGTH);
+      free_map_release(*indirect, 1);
     }
-    cache_write(*doubly, &doubly_d);
+    free_map_release(*doubly, 1);
   }
-
-  ASSERT(allocated == target);
-  inode->allocated = allocated;
-  cache_write(sector, inode);
-  return true;
-}
-
-// If not enough yet, allocate more to ensure inode to have inode->length bytes
-static bool inode_ensure_length(struct inode *inode) {
-  return inode_ensure_sectors(inode, bytes_to_sectors(inode->data.length));
 }
 
 // Release all sectors in this inode
 static void inode_release(struct inode *inode) {
-  size_t cnt = inode->data.allocated;
-  inode->data.allocated = 0;
-  inode_undo_allocate(inode, cnt);
+  if (inode->data.format == INODE_EXTENT)
+    extent_truncate(inode, 0);
+  else
+    indexed_release(&inode->data);
 }
 
-// Extend inode's length up to specified length
-static bool inode_extend(struct inode *inode, off_t length) {
-  off_t old_length = inode->data.length;
-  if (old_length >= length) return true;
+// Set inode's length, sectors past the old end are holes until written
+static void inode_set_length(struct inode *inode, off_t length) {
   inode->data.length = length;
-  if (inode_ensure_length(inode)) {
-    cache_write_at(inode->sector, &length, offsetof(struct inode_disk, length), sizeof(length));
-    return true;
-  } else {
-    inode->data.length = old_length;
-    return false;
-  }
+  cache_write_at(inode->sector, &length, offsetof(struct inode_disk, length), sizeof(length));
 }
 
 /* GXY's code end */
@@ -331,9 +647,9 @@ static bool inode_extend(struct inode *inode, off_t length) {
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, or 0 if that byte is in a hole that was never written. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
@@ -346,15 +662,85 @@ byte_to_sector (const struct inode *inode, off_t pos)
     return -1;
 }
 
+/* GXY's code begin */
+/* Queues the sectors holding bytes [START, END) of INODE for
+   read-ahead, stopping at end of file. */
+void
+inode_prefetch (struct inode *inode, off_t start, off_t end)
+{
+  lock_acquire (&inode->lock);
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (off_t pos = start - start % BLOCK_SECTOR_SIZE; pos < end; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, pos);
+      if (sector != 0)
+        cache_prefetch (sector);
+    }
+  lock_release (&inode->lock);
+}
+/* GXY's code end */
+
+/* old code begin */
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+// static struct list open_inodes;
+/* old code end */
+/* GXY's code begin */
+/* Open inodes by sector, so that opening a single inode twice
+   returns the same `struct inode'. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode_key, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode_key, elem)->sector
+          < hash_entry (b, struct inode_key, elem)->sector);
+}
+
+/* Assigns sectors to the data INODE holds back for delayed
+   allocation, so that it reaches the cache. */
+void
+inode_flush (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+  inode_flush_delayed (inode);
+  lock_release (&inode->lock);
+}
+
+/* Flushes the delayed data of every open inode. */
+void
+inode_flush_all (void)
+{
+  struct hash_iterator i;
+
+  lock_acquire (&open_inodes_lock);
+  hash_first (&i, &open_inodes);
+  while (hash_next (&i))
+    inode_flush (hash_entry (hash_cur (&i), struct inode, key.elem));
+  lock_release (&open_inodes_lock);
+}
+/* GXY's code end */
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  /* old code begin */
+  // list_init (&open_inodes);
+  /* old code end */
+  /* GXY's code begin */
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+  /* GXY's code end */
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -380,20 +766,18 @@ inode_create (block_sector_t sector, off_t length)
   // disk_inode = calloc (1, sizeof *disk_inode);
   /* old code end */
   /* GXY's code begin */
-  struct inode *inode = calloc(1, sizeof(struct inode));
-  if (inode != NULL && inode) {
-    inode->data.length = length;
-    inode->data.magic = INODE_MAGIC;
-    inode->data.is_dir = false;
-    inode->sector = sector;
-
-    if (inode_ensure_length(inode)) {
-      cache_write_at(inode->sector, &length, offsetof(struct inode_disk, length), sizeof(length));
-      cache_write_at(inode->sector, &inode->data.magic, offsetof(struct inode_disk, magic), sizeof(inode->data.magic));
-      cache_write_at(inode->sector, &inode->data.is_dir, offsetof(struct inode_disk, is_dir), sizeof(inode->data.is_dir));
-      success = true;
-    }
-    free(inode);
+  // no sector is allocated, the file starts as one hole of length bytes
+  struct inode_disk *disk_inode = calloc(1, sizeof *disk_inode);
+  if (disk_inode != NULL) {
+    disk_inode->length = length;
+    disk_inode->magic = INODE_MAGIC;
+    disk_inode->is_dir = false;
+    disk_inode->format = inode_format;
+
+    // the sector may hold an old inode, so write all of it
+    cache_write(sector, disk_inode);
+    success = true;
+    free(disk_inode);
   }
   return success;
   /* GXY's code end */
@@ -439,28 +823,58 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  /* old code begin */
+  // struct list_elem *e;
+  /* old code end */
   struct inode *inode;
+  /* GXY's code begin */
+  struct inode_key key;
+  struct hash_elem *e;
+  /* GXY's code end */
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* old code begin */
+  // for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+  //      e = list_next (e)) 
+  //   {
+  //     inode = list_entry (e, struct inode, elem);
+  //     if (inode->sector == sector) 
+  //       {
+  //         inode_reopen (inode);
+  //         return inode; 
+  //       }
+  //   }
+  /* old code end */
+  /* GXY's code begin */
+  lock_acquire (&open_inodes_lock);
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, key.elem);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      // wait until its opener has read it
+      lock_acquire (&inode->lock);
+      lock_release (&inode->lock);
+      return inode;
     }
+  /* GXY's code end */
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      /* GXY's code begin */
+      lock_release (&open_inodes_lock);
+      /* GXY's code end */
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* old code begin */
+  // list_push_front (&open_inodes, &inode->elem);
+  /* old code end */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
@@ -469,7 +883,23 @@ inode_open (block_sector_t sector)
   // block_read (fs_device, inode->sector, &inode->data);
   /* old code end */
   /* GXY's code begin */
-  cache_read(inode->sector, &inode->data);
+  inode->key.sector = sector;
+  inode->hint.length = 0;
+  inode->goal = 0;
+  inode->prealloc_cnt = 0;
+  inode->delayed = NULL;
+  inode->delayed_cnt = 0;
+  inode->reserved_cnt = 0;
+  inode->flushing = false;
+  lock_init (&inode->lock);
+  rwlock_init (&inode->dir_lock);
+  // published before the on-disk inode is read, without open_inodes_lock,
+  // openers of the same sector wait for inode->lock
+  lock_acquire (&inode->lock);
+  hash_insert (&open_inodes, &inode->key.elem);
+  lock_release (&open_inodes_lock);
+  cache_read (inode->sector, &inode->data);
+  lock_release (&inode->lock);
   /* GXY's code end */
   return inode;
 }
@@ -479,7 +909,13 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    /* GXY's code begin */
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
+    /* GXY's code end */
   return inode;
 }
 
@@ -500,11 +936,40 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
+  /* GXY's code begin */
+  bool last;
+  lock_acquire (&open_inodes_lock);
+  // the last closer links the delayed data without open_inodes_lock, but
+  // keeps its reference meanwhile: an inode_open() of the same sector then
+  // reuses this inode instead of reading the on-disk inode too early
+  while (inode->open_cnt == 1 && !inode->removed && inode->delayed_cnt > 0)
+    {
+      lock_release (&open_inodes_lock);
+      inode_flush (inode);
+      lock_acquire (&open_inodes_lock);
+    }
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->key.elem);
+  lock_release (&open_inodes_lock);
+  if (last)
+    {
+      palloc_free_page (inode->delayed);
+      free_map_unreserve (inode->reserved_cnt);
+      inode_release_prealloc (inode);
+    }
+  /* GXY's code end */
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  /* old code begin */
+  // if (--inode->open_cnt == 0)
+  /* old code end */
+  if (last)
     {
       /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      /* old code begin */
+      // list_remove (&inode->elem);
+      /* old code end */
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
@@ -543,9 +1008,17 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   /* old code begin */
   // uint8_t *bounce = NULL;
   /* old code end */
+  /* GXY's code begin */
+  // delayed data is copied out under inode->lock, and into BUFFER,
+  // which may be user memory that faults, after releasing it
+  uint8_t bounce[BLOCK_SECTOR_SIZE];
+  /* GXY's code end */
 
   while (size > 0) 
     {
+      /* GXY's code begin */
+      lock_acquire (&inode->lock);
+      /* GXY's code end */
       /* Disk sector to read, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
@@ -558,9 +1031,34 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
-        break;
+        /* GXY's code begin */
+        {
+          lock_release (&inode->lock);
+          break;
+        }
+        /* GXY's code end */
+
+      /* GXY's code begin */
+      // holes read as zeros, unless written data waits for a sector,
+      // which is only stable with the lock held
+      const uint8_t *delayed = NULL;
+      if (sector_idx == 0)
+        {
+          delayed = inode_delayed_data (inode, offset / BLOCK_SECTOR_SIZE);
+          if (delayed != NULL)
+            delayed = memcpy (bounce, delayed + sector_ofs, chunk_size);
+        }
+      lock_release (&inode->lock);
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx == 0)
+        {
+          if (delayed != NULL)
+            memcpy (buffer + bytes_read, delayed, chunk_size);
+          else
+            memset (buffer + bytes_read, 0, chunk_size);
+        }
+      /* GXY's code end */
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
           /* Read full sector directly into caller's buffer. */
           /* old code begin */
@@ -615,39 +1113,71 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   /* old code begin */
   // uint8_t *bounce = NULL;
   /* old code end */
+  /* GXY's code begin */
+  // BUFFER may be user memory that faults, so each chunk is copied in
+  // before taking inode->lock
+  uint8_t bounce[BLOCK_SECTOR_SIZE];
+  /* GXY's code end */
 
   if (inode->deny_write_cnt)
     return 0;
 
-  /* GXY's code begin */
-  if (!inode_extend(inode, offset + size))
-    return 0;
-  /* GXY's code end */
-
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* old code begin */
+      // block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* old code end */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
+      /* old code begin */
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      // off_t inode_left = inode_length (inode) - offset;
+      // int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      // int min_left = inode_left < sector_left ? inode_left : sector_left;
+      /* old code end */
+      /* GXY's code begin */
+      // the file grows to cover what is written, see below
+      int min_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      /* GXY's code end */
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* GXY's code begin */
+      // a hole written in order waits in the delayed buffer, any other one
+      // gets its sector now, holding the data if all of it is written
+      memcpy (bounce, buffer + bytes_written, chunk_size);
+      lock_acquire (&inode->lock);
+      uint8_t *delayed = inode_delay (inode, offset / BLOCK_SECTOR_SIZE);
+      block_sector_t sector_idx = 0;
+      bool filled = false;
+      if (delayed != NULL)
+        memcpy (delayed + sector_ofs, bounce, chunk_size);
+      else
+        sector_idx = inode_map (inode, offset / BLOCK_SECTOR_SIZE,
+                                chunk_size == BLOCK_SECTOR_SIZE
+                                ? bounce : NULL,
+                                &filled);
+      lock_release (&inode->lock);
+
+      if (delayed != NULL || filled)
+        {
+          /* Written above. */
+        }
+      else if (sector_idx == 0)
+        break;
+      /* GXY's code end */
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
           /* Write full sector directly to disk. */
           /* old code begin */
           // block_write (fs_device, sector_idx, buffer + bytes_written);
           /* old code end */
           /* GXY's code begin */
-          cache_write(sector_idx, buffer + bytes_written);
+          cache_write(sector_idx, bounce);
           /* GXY's code end */
         }
       else 
@@ -672,7 +1202,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
           // block_write (fs_device, sector_idx, bounce);
           /* old code end */
           /* GXY's code begin */
-          cache_write_at(sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+          cache_write_at(sector_idx, bounce, sector_ofs, chunk_size);
           /* GXY's code end */
         }
 
@@ -684,6 +1214,15 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   /* old code begin */
   // free (bounce);
   /* old code end */
+  /* GXY's code begin */
+  // the length covers the written bytes only once they are in the cache or
+  // the delayed buffer, so a reader never sees the file grow before its data;
+  // a write that runs out of space grows it by what was written
+  lock_acquire (&inode->lock);
+  if (offset > inode_length (inode))
+    inode_set_length (inode, offset);
+  lock_release (&inode->lock);
+  /* GXY's code end */
 
   return bytes_written;
 }
@@ -693,8 +1232,14 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  /* GXY's code begin */
+  lock_acquire (&inode->lock);
+  /* GXY's code end */
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  /* GXY's code begin */
+  lock_release (&inode->lock);
+  /* GXY's code end */
 }
 
 /* Re-enables writes to INODE.
@@ -703,9 +1248,15 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  /* GXY's code begin */
+  lock_acquire (&inode->lock);
+  /* GXY's code end */
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  /* GXY's code begin */
+  lock_release (&inode->lock);
+  /* GXY's code end */
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -714,3 +1265,33 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* GXY's code begin */
+/* Acquires the directory lock of INODE for looking entries up. */
+void
+inode_lock_shared (struct inode *inode)
+{
+  rwlock_acquire_read (&inode->dir_lock);
+}
+
+/* Releases the directory lock of INODE after inode_lock_shared(). */
+void
+inode_unlock_shared (struct inode *inode)
+{
+  rwlock_release_read (&inode->dir_lock);
+}
+
+/* Acquires the directory lock of INODE for changing entries. */
+void
+inode_lock_exclusive (struct inode *inode)
+{
+  rwlock_acquire_write (&inode->dir_lock);
+}
+
+/* Releases the directory lock of INODE after inode_lock_exclusive(). */
+void
+inode_unlock_exclusive (struct inode *inode)
+{
+  rwlock_release_write (&inode->dir_lock);
+}
+/* GXY's code end */
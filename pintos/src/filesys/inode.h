@@ -22,6 +22,27 @@ void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 
+/* GXY's code begin */
+/* On-disk layouts of the sectors of a file. */
+enum inode_format
+  {
+    INODE_INDEXED,              /* Direct, indirect and doubly indirect. */
+    INODE_EXTENT                /* Runs of contiguous sectors. */
+  };
+
+extern enum inode_format inode_format;
+
+enum inode_format sector_get_format (block_sector_t);
+void inode_prefetch (struct inode *, off_t start, off_t end);
+size_t inode_fragments (struct inode *);
+void inode_flush (struct inode *);
+void inode_flush_all (void);
+void inode_lock_shared (struct inode *);
+void inode_unlock_shared (struct inode *);
+void inode_lock_exclusive (struct inode *);
+void inode_unlock_exclusive (struct inode *);
+/* GXY's code end */
+
 /* yy's code begin */
 int inode_get_opencnt(const struct inode *);
 bool inode_isdir(const struct inode *);
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -358,6 +359,31 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Copies the elements of B holding bits START through START +
+   CNT - 1 into DST, as bitmap_write() would write them, starting
+   at file offset START / CHAR_BIT.  START must be a multiple of
+   the number of bits in an element.
+   Returns the number of bytes copied. */
+size_t
+bitmap_copy_range (const struct bitmap *b, size_t start, size_t cnt,
+                   void *dst)
+{
+  size_t first, last, size;
+
+  ASSERT (b != NULL);
+  ASSERT (start % ELEM_BITS == 0);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return 0;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  size = (last - first + 1) * sizeof (elem_type);
+  memcpy (dst, b->bits + first, size);
+  return size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -0,0 +1,51 @@
+#include <ring.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Initializes RING with both queues empty. */
+void
+ring_init (struct ring *ring) 
+{
+  memset (ring, 0, sizeof *ring);
+}
+
+/* Appends an operation to RING's submission queue.  Returns
+   false if the queue is full. */
+bool
+ring_queue (struct ring *ring, int op, int fd, void *addr, unsigned len,
+            unsigned user_data) 
+{
+  struct ring_sqe *sqe;
+
+  if (ring->sq_tail - ring->sq_head >= RING_ENTRIES)
+    return false;
+  sqe = &ring->sq[ring->sq_tail % RING_ENTRIES];
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->addr = addr;
+  sqe->len = len;
+  sqe->user_data = user_data;
+  ring->sq_tail++;
+  return true;
+}
+
+/* Runs the queued operations with one system call.  Returns the
+   number of operations run, which is less than the number queued
+   if the completion queue filled up. */
+int
+ring_submit (struct ring *ring) 
+{
+  return ring_enter (ring);
+}
+
+/* Removes the oldest completion from RING into *CQE.  Returns
+   false if there is none. */
+bool
+ring_complete (struct ring *ring, struct ring_cqe *cqe) 
+{
+  if (ring->cq_head == ring->cq_tail)
+    return false;
+  *cqe = ring->cq[ring->cq_head % RING_ENTRIES];
+  ring->cq_head++;
+  return true;
+}
@@ -0,0 +1,65 @@
+#ifndef __LIB_USER_RING_H
+#define __LIB_USER_RING_H
+
+#include <stdbool.h>
+
+/* A submission/completion ring batches system calls: the program
+   queues several operations in the submission queue and hands
+   them all to the kernel with one ring_enter() trap, which runs
+   them in order and appends their results to the completion
+   queue.
+
+   Queue indexes only ever increase and are taken modulo
+   RING_ENTRIES.  The program advances SQ_TAIL and CQ_HEAD, the
+   kernel advances SQ_HEAD and CQ_TAIL. */
+
+/* Entries in each queue. */
+#define RING_ENTRIES 32
+
+/* Operations. */
+enum ring_op
+  {
+    RING_NOP,                   /* Nothing, completes with 0. */
+    RING_CREATE,                /* create (ADDR, LEN). */
+    RING_REMOVE,                /* remove (ADDR). */
+    RING_OPEN,                  /* open (ADDR). */
+    RING_CLOSE,                 /* close (FD), completes with 0. */
+    RING_READ,                  /* read (FD, ADDR, LEN). */
+    RING_WRITE,                 /* write (FD, ADDR, LEN). */
+    RING_MKDIR                  /* mkdir (ADDR). */
+  };
+
+/* Submission queue entry. */
+struct ring_sqe
+  {
+    int op;                     /* One of enum ring_op. */
+    int fd;                     /* File descriptor. */
+    void *addr;                 /* Buffer or file name. */
+    unsigned len;               /* Buffer length or initial size. */
+    unsigned user_data;         /* Passed back in the completion. */
+  };
+
+/* Completion queue entry. */
+struct ring_cqe
+  {
+    unsigned user_data;         /* From the submission. */
+    int result;                 /* Return value of the operation. */
+  };
+
+struct ring
+  {
+    unsigned sq_head;           /* Next submission the kernel runs. */
+    unsigned sq_tail;           /* Next free submission slot. */
+    unsigned cq_head;           /* Next completion to consume. */
+    unsigned cq_tail;           /* Next free completion slot. */
+    struct ring_sqe sq[RING_ENTRIES];
+    struct ring_cqe cq[RING_ENTRIES];
+  };
+
+void ring_init (struct ring *);
+bool ring_queue (struct ring *, int op, int fd, void *addr, unsigned len,
+                 unsigned user_data);
+int ring_submit (struct ring *);
+bool ring_complete (struct ring *, struct ring_cqe *);
+
+#endif /* lib/user/ring.h */
@@ -15,6 +15,16 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* One buffer for readv() and writev(). */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    unsigned iov_len;           /* Size of the buffer in bytes. */
+  };
+
+/* Maximum number of buffers passed to readv() or writev(). */
+#define IOV_MAX 64
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +55,13 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int pread (int fd, void *buffer, unsigned length, unsigned position);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned position);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, int fd_out, unsigned length);
+struct ring;
+int ring_enter (struct ring *);
+
 #endif /* lib/user/syscall.h */
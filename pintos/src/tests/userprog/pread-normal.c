@@ -0,0 +1,36 @@
+/* Reads "sample.txt" with pread() at several positions, including
+   one that runs past the end of the file, and checks that the
+   file position is left alone. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const unsigned positions[] = {100, 0, 37, sizeof sample - 11};
+  char buffer[32];
+  int handle;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  for (i = 0; i < sizeof positions / sizeof *positions; i++) 
+    {
+      unsigned pos = positions[i];
+      int expected = sizeof sample - 1 - pos;
+      int byte_cnt;
+
+      if (expected > (int) sizeof buffer)
+        expected = sizeof buffer;
+      byte_cnt = pread (handle, buffer, sizeof buffer, pos);
+      if (byte_cnt != expected)
+        fail ("pread() at %u returned %d instead of %d",
+              pos, byte_cnt, expected);
+      compare_bytes (buffer, sample + pos, byte_cnt, pos, "sample.txt");
+    }
+  if (tell (handle) != 0)
+    fail ("pread() moved the file position to %u", tell (handle));
+  msg ("verified pread() of \"sample.txt\"");
+}
@@ -0,0 +1,39 @@
+/* Writes a file with pwrite() back to front, then checks its
+   contents and that the file position is left alone. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK 50
+
+void
+test_main (void) 
+{
+  int handle;
+  int pos;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  msg ("pwrite \"test.txt\" back to front");
+  for (pos = (sizeof sample - 2) / CHUNK * CHUNK; pos >= 0; pos -= CHUNK) 
+    {
+      int size = sizeof sample - 1 - pos;
+      int byte_cnt;
+
+      if (size > CHUNK)
+        size = CHUNK;
+      byte_cnt = pwrite (handle, sample + pos, size, pos);
+      if (byte_cnt != size)
+        fail ("pwrite() at %d returned %d instead of %d",
+              pos, byte_cnt, size);
+    }
+  if (tell (handle) != 0)
+    fail ("pwrite() moved the file position to %u", tell (handle));
+
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+  msg ("close \"test.txt\"");
+  close (handle);
+}
@@ -0,0 +1,38 @@
+/* Reads "sample.txt" with one readv() into three buffers of
+   different sizes, the last one larger than what is left. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char first[10], second[100], third[sizeof sample];
+  struct iovec iov[3];
+  int handle, byte_cnt;
+
+  iov[0].iov_base = first;
+  iov[0].iov_len = sizeof first;
+  iov[1].iov_base = second;
+  iov[1].iov_len = sizeof second;
+  iov[2].iov_base = third;
+  iov[2].iov_len = sizeof third;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  byte_cnt = readv (handle, iov, 3);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("readv() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+
+  compare_bytes (first, sample, sizeof first, 0, "sample.txt");
+  compare_bytes (second, sample + sizeof first, sizeof second,
+                 sizeof first, "sample.txt");
+  compare_bytes (third, sample + sizeof first + sizeof second,
+                 sizeof sample - 1 - sizeof first - sizeof second,
+                 sizeof first + sizeof second, "sample.txt");
+  if (tell (handle) != sizeof sample - 1)
+    fail ("readv() left the file position at %u", tell (handle));
+  msg ("verified readv() of \"sample.txt\"");
+}
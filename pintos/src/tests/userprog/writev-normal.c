@@ -0,0 +1,32 @@
+/* Writes a file with one writev() from three buffers, one of
+   them empty, and checks its contents. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct iovec iov[3];
+  int handle, byte_cnt;
+
+  iov[0].iov_base = sample;
+  iov[0].iov_len = 64;
+  iov[1].iov_base = sample + 64;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = sample + 64;
+  iov[2].iov_len = sizeof sample - 1 - 64;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("writev() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+
+  msg ("close \"test.txt\"");
+  close (handle);
+  check_file ("test.txt", sample, sizeof sample - 1);
+}
@@ -36,6 +36,10 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+/* GXY's code begin */
+#include "filesys/cache.h"
+#include "filesys/inode.h"
+/* GXY's code end */
 #endif
 
 /* GLS's code begin */
@@ -72,6 +76,9 @@ static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
+/* GXY's code begin */
+static int parse_count (const char *value);
+/* GXY's code end */
 
 #ifdef FILESYS
 static void locate_block_devices (void);
@@ -138,7 +145,6 @@ pintos_init (void)
 /* GLS's code begin */
 #ifdef VM
   frame_table_init();
-  page_table_lock_init();
   swap_init();
 #endif
 /* GLS's code end */
@@ -243,6 +249,26 @@ read_command_line (void)
   return argv;
 }
 
+/* GXY's code begin */
+/* Returns VALUE as a decimal number, or -1 if it is not one
+   made of digits only or does not fit in an int. */
+static int
+parse_count (const char *value)
+{
+  int n = 0;
+
+  if (value == NULL || *value == '\0')
+    return -1;
+  for (; *value != '\0'; value++)
+    {
+      if (*value < '0' || *value > '9' || n > (INT_MAX - 9) / 10)
+        return -1;
+      n = n * 10 + (*value - '0');
+    }
+  return n;
+}
+/* GXY's code end */
+
 /* Parses options in ARGV[]
    and returns the first non-option argument. */
 static char **
@@ -267,6 +293,41 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      /* GXY's code begin */
+      else if (!strcmp (name, "-cache"))
+        {
+          int size = parse_count (value);
+          if (size <= 0)
+            PANIC ("-cache needs a positive number of sectors, not `%s'",
+                   value);
+          cache_size = size;
+        }
+      else if (!strcmp (name, "-cache-policy"))
+        {
+          if (!cache_set_policy (value))
+            PANIC ("unknown cache policy `%s'", value);
+        }
+      else if (!strcmp (name, "-cache-flush"))
+        {
+          int interval = parse_count (value);
+          if (interval < 0)
+            PANIC ("-cache-flush needs a number of milliseconds, not `%s'",
+                   value);
+          cache_flush_interval = interval;
+        }
+      else if (!strcmp (name, "-cache-dirty"))
+        {
+          int ratio = parse_count (value);
+          if (ratio < 0 || ratio > 100)
+            PANIC ("-cache-dirty needs a percentage from 0 to 100, not `%s'",
+                   value);
+          cache_dirty_ratio = ratio;
+        }
+      else if (!strcmp (name, "-extents"))
+        inode_format = INODE_EXTENT;
+      else if (!strcmp (name, "-ide-dma"))
+        ide_use_dma = true;
+      /* GXY's code end */
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -333,6 +394,7 @@ run_actions (char **argv)
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
+      {"frag", 2, fsutil_frag},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
 #endif
@@ -381,6 +443,7 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  frag FILE          Report fragmentation of FILE and free space.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -393,6 +456,12 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=COUNT       Cache COUNT disk sectors (default 64).\n"
+          "  -cache-policy=NAME Replace cache blocks by `clock' or `2q'.\n"
+          "  -cache-flush=MS    Flush dirty cache blocks every MS ms (0: never).\n"
+          "  -cache-dirty=PCT   Flush early once PCT%% of the cache is dirty.\n"
+          "  -extents           With -f, use extent-based inodes.\n"
+          "  -ide-dma           Transfer disk sectors by bus-master DMA.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -425,3 +425,72 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* GXY's code begin */
+/* Initializes RWLOCK as held by nobody. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->lock);
+  cond_init (&rwlock->read_ok);
+  cond_init (&rwlock->write_ok);
+  rwlock->readers = 0;
+  rwlock->waiting_writers = 0;
+  rwlock->writing = false;
+}
+
+/* Acquires RWLOCK for reading, sleeping until no thread writes
+   or waits to write. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writing || rwlock->waiting_writers > 0)
+    cond_wait (&rwlock->read_ok, &rwlock->lock);
+  rwlock->readers++;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0)
+    cond_signal (&rwlock->write_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+   holds it. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->lock);
+  rwlock->waiting_writers++;
+  while (rwlock->writing || rwlock->readers > 0)
+    cond_wait (&rwlock->write_ok, &rwlock->lock);
+  rwlock->waiting_writers--;
+  rwlock->writing = true;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for writing.
+   Another writer goes first if there is one, otherwise all
+   waiting readers are let in. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->writing);
+  rwlock->writing = false;
+  if (rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->write_ok, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->read_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+/* GXY's code end */
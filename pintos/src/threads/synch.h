@@ -41,6 +41,30 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* GXY's code begin */
+/* Readers-writer lock.
+   Any number of threads may hold it for reading at once, or a
+   single thread for writing.  Waiting writers hold off new
+   readers, so that a steady stream of readers cannot starve
+   them; a thread must therefore not acquire it for reading
+   twice. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the fields below. */
+    struct condition read_ok;   /* Signaled when readers may enter. */
+    struct condition write_ok;  /* Signaled when a writer may enter. */
+    int readers;                /* Number of threads reading. */
+    int waiting_writers;        /* Number of threads waiting to write. */
+    bool writing;               /* Whether a thread is writing. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+/* GXY's code end */
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -629,8 +629,8 @@ init_thread (struct thread *t, const char *name, int priority)
   #endif
   #ifdef VM
     t->current_esp = NULL;
-    t->mmap_count = 0;
-    list_init(&(t->mmap_list));
+    lock_init(&t->page_table_lock);
+    desc_table_init(&(t->mmap_table), 0);
   #endif
   /* GLS's code end */
 }
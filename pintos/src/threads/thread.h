@@ -4,6 +4,10 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/synch.h"
+#ifdef VM
+#include "userprog/desc-table.h"
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -107,8 +111,8 @@ struct thread
 /* GLS's code begin */
 #ifdef VM
    struct hash *page_table;
-   int mmap_count;
-   struct list mmap_list;
+   struct lock page_table_lock;   /* protects page_table and its pages in pagedir */
+   struct desc_table mmap_table;  /* struct mmap_file by mapping id */
    void* current_esp;   
 #endif
 /* GLS's code end */
@@ -0,0 +1,116 @@
+#include "userprog/desc-table.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+
+/* GLS's code begin */
+
+/* Slots in a table when its first descriptor is added. */
+#define DESC_TABLE_INIT_SIZE 16
+
+/* Initializes TABLE as empty, handing out ids from BASE on.
+   No memory is allocated until the first descriptor is added. */
+void
+desc_table_init (struct desc_table *table, int base)
+{
+  table->slots = NULL;
+  table->used = NULL;
+  table->size = 0;
+  table->base = base;
+}
+
+/* Doubles the number of slots in TABLE.
+   Returns false if memory allocation fails. */
+static bool
+desc_table_grow (struct desc_table *table)
+{
+  size_t new_size = table->size == 0 ? DESC_TABLE_INIT_SIZE : table->size * 2;
+  void **slots = realloc (table->slots, new_size * sizeof *slots);
+  if (slots == NULL)
+    return false;
+  table->slots = slots;
+  memset (slots + table->size, 0, (new_size - table->size) * sizeof *slots);
+
+  struct bitmap *used = bitmap_create (new_size);
+  if (used == NULL)
+    return false;
+  if (table->used != NULL)
+    {
+      size_t i;
+      for (i = 0; i < table->size; ++i)
+        bitmap_set (used, i, bitmap_test (table->used, i));
+      bitmap_destroy (table->used);
+    }
+  table->used = used;
+  table->size = new_size;
+  return true;
+}
+
+/* Adds DESC to TABLE under the lowest free id and returns it,
+   or -1 if memory allocation fails. */
+int
+desc_table_add (struct desc_table *table, void *desc)
+{
+  ASSERT (desc != NULL);
+  size_t slot = table->used != NULL
+                ? bitmap_scan_and_flip (table->used, 0, 1, false)
+                : BITMAP_ERROR;
+  if (slot == BITMAP_ERROR)
+    {
+      slot = table->size;
+      if (!desc_table_grow (table))
+        return -1;
+      bitmap_mark (table->used, slot);
+    }
+  table->slots[slot] = desc;
+  return table->base + (int) slot;
+}
+
+/* Returns the descriptor with the given ID in TABLE,
+   or a null pointer if there is none. */
+void *
+desc_table_get (const struct desc_table *table, int id)
+{
+  if (id < table->base || (size_t) (id - table->base) >= table->size)
+    return NULL;
+  return table->slots[id - table->base];
+}
+
+/* Removes the descriptor with the given ID from TABLE, freeing
+   its id, and returns it, or a null pointer if there is none. */
+void *
+desc_table_remove (struct desc_table *table, int id)
+{
+  void *desc = desc_table_get (table, id);
+  if (desc != NULL)
+    {
+      table->slots[id - table->base] = NULL;
+      bitmap_reset (table->used, id - table->base);
+    }
+  return desc;
+}
+
+/* Removes and returns any descriptor in TABLE,
+   or a null pointer if TABLE is empty. */
+void *
+desc_table_pop (struct desc_table *table)
+{
+  if (table->used == NULL)
+    return NULL;
+  size_t slot = bitmap_scan (table->used, 0, 1, true);
+  if (slot == BITMAP_ERROR)
+    return NULL;
+  return desc_table_remove (table, table->base + (int) slot);
+}
+
+/* Frees the memory of TABLE, which must be empty. */
+void
+desc_table_destroy (struct desc_table *table)
+{
+  free (table->slots);
+  if (table->used != NULL)
+    bitmap_destroy (table->used);
+  desc_table_init (table, table->base);
+}
+
+/* GLS's code end */
@@ -0,0 +1,32 @@
+#ifndef USERPROG_DESC_TABLE_H
+#define USERPROG_DESC_TABLE_H
+
+/* GLS's code begin */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <bitmap.h>
+
+/* A table of a process's descriptors (open files, mappings),
+   indexed by id so that finding one is constant-time.
+   Ids below BASE are reserved, and a new descriptor gets the
+   lowest free id, found in the USED bitmap.  The table grows by
+   doubling when it is full. */
+struct desc_table
+  {
+    void **slots;           /* slots[id - base], NULL if free. */
+    struct bitmap *used;    /* Which slots are taken. */
+    size_t size;            /* Number of slots. */
+    int base;               /* Lowest id handed out. */
+  };
+
+void desc_table_init (struct desc_table *table, int base);
+int desc_table_add (struct desc_table *table, void *desc);
+void *desc_table_get (const struct desc_table *table, int id);
+void *desc_table_remove (struct desc_table *table, int id);
+void *desc_table_pop (struct desc_table *table);
+void desc_table_destroy (struct desc_table *table);
+
+/* GLS's code end */
+
+#endif /* userprog/desc-table.h */
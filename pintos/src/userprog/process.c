@@ -80,8 +80,7 @@ process_execute (const char *file_name)
   p_desc->exit_status = -1;
   p_desc->load_success = false;
   p_desc->own_file = NULL;
-  list_init(&(p_desc->opened_files));
-  p_desc->opened_count = 2; //STDIN_FILEON, STDIN_FILEON.  
+  desc_table_init(&(p_desc->opened_files), 2); //STDIN_FILEON, STDIN_FILEON.
   sema_init(&(p_desc->load_sema), 0);
   sema_init(&(p_desc->wait_sema), 0);
 
@@ -292,23 +291,21 @@ process_exit (void)
   /* GLS's code begin */
   /* unmap all mmapped files */
 #ifdef VM
-  struct list *mmap_list = &(cur->mmap_list);
-  while (!list_empty (mmap_list)) {
-    struct list_elem *front = list_pop_front (mmap_list);
-    struct mmap_file *mmap_f = list_entry (front, struct mmap_file, elem);
+  struct mmap_file *mmap_f;
+  while ((mmap_f = desc_table_pop (&(cur->mmap_table))) != NULL) {
     syscall_munmap_file (mmap_f);
   }
+  desc_table_destroy (&(cur->mmap_table));
 #endif
   /* close all opened files */
   struct process_descriptor *p_desc = cur->p_desc;
   // printf ("process_exit: %x %d\n", p_desc, p_desc->pid);
-  struct list *opened_files = &(p_desc->opened_files);
-  while (!list_empty (opened_files)) {
-    struct list_elem *front = list_pop_front (opened_files);
-    struct file_descriptor *f_desc = list_entry (front, struct file_descriptor, elem);
+  struct file_descriptor *f_desc;
+  while ((f_desc = desc_table_pop (&(p_desc->opened_files))) != NULL) {
     syscall_close_file (f_desc);
     /* syscall_close_file() : implemented in 'syscall.c' specially. */
   }
+  desc_table_destroy (&(p_desc->opened_files));
 
   /* free children's process_descriptor */
   struct list *child_process = &(cur->child_process);
@@ -668,7 +665,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   page_table_type *page_table = current_thread->page_table;
   if (page_available_mmap (page_table, page_num, upage)) {
     struct mmap_file *mmap_f = malloc (sizeof (struct mmap_file));
-    mmap_f->id = current_thread->mmap_count++;
     mmap_f->addr = upage;
     mmap_f->file = file;
     mmap_f->file_bytes = read_bytes;
@@ -677,8 +673,11 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
     mmap_f->writable = writable;
     mmap_f->static_data = writable;
     if (page_install_mmap (page_table, page_num, mmap_f)) {
-      list_push_back (&(current_thread->mmap_list), &(mmap_f->elem));
-      return true;
+      mmap_f->id = desc_table_add (&(current_thread->mmap_table), mmap_f);
+      if (mmap_f->id != -1)
+        return true;
+      syscall_munmap_file (mmap_f);
+      return false;
     }
     else {
       free (mmap_f);
@@ -6,6 +6,7 @@
 /* GLS's code begin */
 #include "threads/synch.h"
 #include "filesys/file.h"
+#include "userprog/desc-table.h"
 #define PID_INIT ((pid_t) -1)
 typedef int pid_t;
 /* GLS's code end */
@@ -26,8 +27,7 @@ struct process_descriptor {
     int exit_status;
     struct list_elem elem;
     struct file* own_file;  
-    struct list opened_files;
-    int opened_count;
+    struct desc_table opened_files;  // struct file_descriptor by fd
     bool load_success;
     struct semaphore load_sema;
     struct semaphore wait_sema;
@@ -20,6 +20,10 @@
 #include "vm/pagetable.h"
 #define SYSCALL_STDIN_FILENO 0
 #define SYSCALL_STDOUT_FILENO 1
+/* GXY's code begin */
+// Bytes written to the console per putbuf call
+#define STDOUT_CHUNK_SIZE 128
+/* GXY's code end */
 /* GLS's code end */
 
 /* yy's code begin */
@@ -27,6 +31,10 @@
 #include "filesys/inode.h"
 /* yy's code end */
 
+/* GXY's code begin */
+#include "user/ring.h"
+/* GXY's code end */
+
 static void syscall_handler (struct intr_frame *);
 
 /* GLS's code begin */
@@ -45,18 +53,25 @@ static unsigned syscall_tell (int fd);
 static void syscall_close (int fd);
 static struct file_descriptor* find_file (struct thread *t, fid_t fd);
 /* The following functions is used to handle invalid user virtual addres. */
-static int get_user (const uint8_t *uaddr);
-static bool put_user (uint8_t *udst, uint8_t byte);
-static void read_user (void *uaddr, void *dest, unsigned size);
 static bool is_valid_uaddr (void *uaddr);
-static bool is_valid_user_string (const char *str);
 static bool is_valid_user_buffer (const void* buffer, off_t size);
+/* GXY's code begin */
+static void copy_from_user (void *dst, const void *usrc, size_t size);
+static void copy_to_user (void *udst, const void *src, size_t size);
+static size_t strnlen_user (const char *ustr, size_t size);
+static char *copy_in_string (const char *ustr);
+static off_t file_io_user (struct file *file, void *buffer, off_t size, bool write, off_t *ofs);
+static int syscall_pread (int fd, void *buffer, off_t size, off_t position);
+static int syscall_pwrite (int fd, const void *buffer, off_t size, off_t position);
+static int syscall_rwv (int fd, const struct iovec *uiov, int iovcnt, bool write);
+static int syscall_copy_file_range (int fd_in, int fd_out, off_t size);
+static int syscall_ring_enter (struct ring *uring);
+/* GXY's code end */
 
 
 #ifdef VM
 static mmapid_t syscall_mmap(int fd, void *addr);
 static void syscall_munmap(mmapid_t id);
-static struct mmap_file* find_mmap_file (struct thread *t, mmapid_t id);
 #endif
 /* GLS's code end */
 
@@ -69,19 +84,10 @@ static block_sector_t syscall_inumber(int fd);
 /* yy's code end */
 
 
-/* GLS's code begin */
-/* As suggested by 4.3.4, only a user process can call into file system at once.
-This means the code in the folder 'filesys' is a critical section. */
-static struct lock syscall_filesys_lock;
-/* GLS's code end */
-
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  /* GLS's code begin */
-  lock_init (&syscall_filesys_lock);
-  /* GLS's code end */
 }
 
 
@@ -99,7 +105,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 #endif   
 
   int syscall_number = 0;
-  read_user(f->esp, &syscall_number, sizeof (int));
+  copy_from_user (&syscall_number, f->esp, sizeof (int));
   //printf ("syscall_number  %d\n", syscall_number);
   switch (syscall_number)
   {
@@ -110,23 +116,23 @@ syscall_handler (struct intr_frame *f UNUSED)
   
   case SYS_EXIT: {
     int exit_status;
-    read_user (f->esp + sizeof (int), &exit_status, sizeof (exit_status));
+    copy_from_user (&exit_status, f->esp + sizeof (int), sizeof (exit_status));
     syscall_exit (exit_status);
     break;
   }
   
   case SYS_EXEC: {
     const char *cmd_line;
-    read_user (f->esp + sizeof (int), &cmd_line, sizeof (cmd_line));
-    if (is_valid_user_string (cmd_line)) {
-      f->eax = syscall_exec(cmd_line);
-    }
+    copy_from_user (&cmd_line, f->esp + sizeof (int), sizeof (cmd_line));
+    char *kcmd_line = copy_in_string (cmd_line);
+    f->eax = kcmd_line != NULL ? syscall_exec (kcmd_line) : PID_ERROR;
+    palloc_free_page (kcmd_line);
     break;
   }
 
   case SYS_WAIT: {
     pid_t pid;
-    read_user (f->esp + sizeof (int), &pid, sizeof (pid));
+    copy_from_user (&pid, f->esp + sizeof (int), sizeof (pid));
     f->eax = syscall_wait (pid);
     break;
   }
@@ -134,35 +140,35 @@ syscall_handler (struct intr_frame *f UNUSED)
   case SYS_CREATE: {
     const char *filename;
     off_t initial_size;
-    read_user (f->esp + sizeof (int), &filename, sizeof (filename));
-    read_user (f->esp + sizeof (int) + sizeof (filename), &initial_size, sizeof (initial_size));
-    if (is_valid_user_string (filename)) {
-      f->eax = syscall_create(filename, initial_size);
-    }
+    copy_from_user (&filename, f->esp + sizeof (int), sizeof (filename));
+    copy_from_user (&initial_size, f->esp + sizeof (int) + sizeof (filename), sizeof (initial_size));
+    char *kfilename = copy_in_string (filename);
+    f->eax = kfilename != NULL && syscall_create (kfilename, initial_size);
+    palloc_free_page (kfilename);
     break;
   }
 
   case SYS_REMOVE: {
     const char *filename;
-    read_user (f->esp + sizeof (int), &filename, sizeof (filename));
-    if (is_valid_user_string (filename)) {
-      f->eax = syscall_remove (filename);
-    }
+    copy_from_user (&filename, f->esp + sizeof (int), sizeof (filename));
+    char *kfilename = copy_in_string (filename);
+    f->eax = kfilename != NULL && syscall_remove (kfilename);
+    palloc_free_page (kfilename);
     break;
   }
 
   case SYS_OPEN: {
     const char *filename;
-    read_user (f->esp + sizeof (int), &filename, sizeof (filename));
-    if (is_valid_user_string (filename)) {
-      f->eax = syscall_open (filename);
-    }
+    copy_from_user (&filename, f->esp + sizeof (int), sizeof (filename));
+    char *kfilename = copy_in_string (filename);
+    f->eax = kfilename != NULL ? syscall_open (kfilename) : -1;
+    palloc_free_page (kfilename);
     break;
   }
 
   case SYS_FILESIZE: {
     int fd;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
     /* save return value to the EAX register */
     f->eax = syscall_filesize(fd);
     break;
@@ -172,9 +178,9 @@ syscall_handler (struct intr_frame *f UNUSED)
     int fd;
     void *buffer;
     off_t size;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
-    read_user (f->esp + sizeof (int) + sizeof (fd), &buffer, sizeof (buffer));
-    read_user (f->esp + sizeof (int) + sizeof (fd) + sizeof (buffer), &size, sizeof (size));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
+    copy_from_user (&buffer, f->esp + sizeof (int) + sizeof (fd), sizeof (buffer));
+    copy_from_user (&size, f->esp + sizeof (int) + sizeof (fd) + sizeof (buffer), sizeof (size));
     if (is_valid_user_buffer (buffer, size)) {
       f->eax = syscall_read (fd, buffer, size);
     }
@@ -185,9 +191,9 @@ syscall_handler (struct intr_frame *f UNUSED)
     int fd;
     const void *buffer;
     off_t size;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
-    read_user (f->esp + sizeof (int) + sizeof (fd), &buffer, sizeof (buffer));
-    read_user (f->esp + sizeof (int) + sizeof (fd) + sizeof (buffer), &size, sizeof (size));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
+    copy_from_user (&buffer, f->esp + sizeof (int) + sizeof (fd), sizeof (buffer));
+    copy_from_user (&size, f->esp + sizeof (int) + sizeof (fd) + sizeof (buffer), sizeof (size));
    // printf ("%d %x %d\n", fd, buffer, size);
     if (is_valid_user_buffer (buffer, size)) {
       f->eax = syscall_write (fd, buffer, size);
@@ -199,22 +205,22 @@ syscall_handler (struct intr_frame *f UNUSED)
   case SYS_SEEK: {
     int fd;
     off_t position;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
-    read_user (f->esp + sizeof (int) + sizeof (fd), &position, sizeof (position));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
+    copy_from_user (&position, f->esp + sizeof (int) + sizeof (fd), sizeof (position));
     syscall_seek (fd, position);
     break;
   }
 
   case SYS_TELL: {
     int fd;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
     f->eax = syscall_tell (fd);
     break;
   }
 
   case SYS_CLOSE: {
     int fd;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
     syscall_close (fd);
     break;
   }
@@ -222,31 +228,35 @@ syscall_handler (struct intr_frame *f UNUSED)
   /* yy's code begin */
   case SYS_CHDIR: {
     const char *dirname;
-    read_user (f->esp + sizeof (int), &dirname, sizeof (dirname));
-    if (is_valid_user_string (dirname) && strlen(dirname) != 0) {
-      f->eax = syscall_chdir(dirname);
+    copy_from_user (&dirname, f->esp + sizeof (int), sizeof (dirname));
+    char *kdirname = copy_in_string (dirname);
+    if (kdirname != NULL && strlen(kdirname) != 0) {
+      f->eax = syscall_chdir(kdirname);
     } else {
       f->eax = false;
     }
+    palloc_free_page (kdirname);
     break;
   }
 
   case SYS_MKDIR: {
     const char *dirname;
-    read_user (f->esp + sizeof (int), &dirname, sizeof (dirname));
-    if (is_valid_user_string (dirname) && strlen(dirname) != 0) {
-      f->eax = syscall_mkdir(dirname);
+    copy_from_user (&dirname, f->esp + sizeof (int), sizeof (dirname));
+    char *kdirname = copy_in_string (dirname);
+    if (kdirname != NULL && strlen(kdirname) != 0) {
+      f->eax = syscall_mkdir(kdirname);
     } else {
       f->eax = false;
     }
+    palloc_free_page (kdirname);
     break;
   }
 
   case SYS_READDIR: {
     int fd;
     void *buffer;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
-    read_user (f->esp + sizeof (int) + sizeof (fd), &buffer, sizeof (buffer));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
+    copy_from_user (&buffer, f->esp + sizeof (int) + sizeof (fd), sizeof (buffer));
     if (fd != 0 && fd != 1 && is_valid_user_buffer (buffer, READDIR_MAX_LEN + 1)) {
       f->eax = syscall_readdir(fd, buffer);
     } else {
@@ -257,7 +267,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 
   case SYS_ISDIR: {
     int fd;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
     if (fd != 0 && fd != 1) {
       f->eax = syscall_isdir(fd);
     } else {
@@ -268,7 +278,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 
   case SYS_INUMBER: {
     int fd;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
     if (fd != 0 && fd != 1) {
       f->eax = syscall_inumber(fd);
     } else {
@@ -277,12 +287,59 @@ syscall_handler (struct intr_frame *f UNUSED)
     break;
   }
   /*yy's code end*/
+  /* GXY's code begin */
+  case SYS_PREAD:
+  case SYS_PWRITE: {
+    int fd;
+    void *buffer;
+    off_t size, position;
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
+    copy_from_user (&buffer, f->esp + 2 * sizeof (int), sizeof (buffer));
+    copy_from_user (&size, f->esp + 3 * sizeof (int), sizeof (size));
+    copy_from_user (&position, f->esp + 4 * sizeof (int), sizeof (position));
+    if (is_valid_user_buffer (buffer, size)) {
+      f->eax = syscall_number == SYS_PREAD
+               ? syscall_pread (fd, buffer, size, position)
+               : syscall_pwrite (fd, buffer, size, position);
+    }
+    break;
+  }
+
+  case SYS_READV:
+  case SYS_WRITEV: {
+    int fd, iovcnt;
+    const struct iovec *iov;
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
+    copy_from_user (&iov, f->esp + 2 * sizeof (int), sizeof (iov));
+    copy_from_user (&iovcnt, f->esp + 3 * sizeof (int), sizeof (iovcnt));
+    f->eax = syscall_rwv (fd, iov, iovcnt, syscall_number == SYS_WRITEV);
+    break;
+  }
+
+  case SYS_COPY_FILE_RANGE: {
+    int fd_in, fd_out;
+    off_t size;
+    copy_from_user (&fd_in, f->esp + sizeof (int), sizeof (fd_in));
+    copy_from_user (&fd_out, f->esp + 2 * sizeof (int), sizeof (fd_out));
+    copy_from_user (&size, f->esp + 3 * sizeof (int), sizeof (size));
+    f->eax = syscall_copy_file_range (fd_in, fd_out, size);
+    break;
+  }
+
+  case SYS_RING_ENTER: {
+    struct ring *uring;
+    copy_from_user (&uring, f->esp + sizeof (int), sizeof (uring));
+    f->eax = syscall_ring_enter (uring);
+    break;
+  }
+  /* GXY's code end */
+
   #ifdef VM
   case SYS_MMAP: {
     int fd;
     void *addr;
-    read_user (f->esp + sizeof (int), &fd, sizeof (fd));
-    read_user (f->esp + sizeof (int) + sizeof (int), &addr, sizeof (addr));
+    copy_from_user (&fd, f->esp + sizeof (int), sizeof (fd));
+    copy_from_user (&addr, f->esp + sizeof (int) + sizeof (int), sizeof (addr));
    // if (is_valid_uaddr (addr)) {
       f->eax = syscall_mmap (fd, addr);
     //}
@@ -291,7 +348,7 @@ syscall_handler (struct intr_frame *f UNUSED)
 
   case SYS_MUNMAP: {
     mmapid_t id;
-    read_user (f->esp + sizeof (int), &id, sizeof (id));
+    copy_from_user (&id, f->esp + sizeof (int), sizeof (id));
     syscall_munmap (id);
     break;
   }
@@ -328,10 +385,7 @@ syscall_exit (int status) {
 /* GLS's code begin */
 static pid_t 
 syscall_exec (const char *cmd_line) {
-  /* process_execute() will call load(), which uses file system. */
-  lock_acquire (&syscall_filesys_lock);
   pid_t pid = process_execute (cmd_line);
-  lock_release (&syscall_filesys_lock);
   return pid;
 }
 /* GLS's code end */
@@ -348,9 +402,7 @@ syscall_wait (pid_t pid) {
 /* GLS's code begin */
 static bool 
 syscall_create (const char *file, off_t initial_size) {
-  lock_acquire (&syscall_filesys_lock);
   bool create_success = filesys_create(file, initial_size);
-  lock_release (&syscall_filesys_lock);
   return create_success;
 }
 /* GLS's code end */
@@ -359,9 +411,7 @@ syscall_create (const char *file, off_t initial_size) {
 /* GLS's code begin */
 static bool 
 syscall_remove (const char *file) {
-  lock_acquire (&syscall_filesys_lock);
   bool create_success = filesys_remove(file);
-  lock_release (&syscall_filesys_lock);
   return create_success;
 }
 /* GLS's code end */
@@ -371,31 +421,33 @@ syscall_remove (const char *file) {
 static int
 syscall_open (const char *file) {
   int return_value = -1;
-  
-  lock_acquire (&syscall_filesys_lock);
   struct file *opened_file = filesys_open(file);
   
   if (opened_file != NULL) {
     struct thread *current_thread = thread_current();
     struct process_descriptor *p_desc = current_thread->p_desc;
-    struct file_descriptor *f_desc = palloc_get_page(0);
+    struct file_descriptor *f_desc = malloc(sizeof *f_desc);
     if (f_desc == NULL) {
-      // printf("[Error] open(): can't palloc a new page.\n");
+      // printf("[Error] open(): can't malloc a new descriptor.\n");
+      file_close (opened_file);
     }
     else {
       f_desc->file = opened_file;
-      f_desc->id = p_desc->opened_count++;
       /* GXY's code begin */
       if (inode_isdir(file_get_inode(opened_file)))
         f_desc->dir = dir_open(inode_reopen(file_get_inode(opened_file)));
       else
         f_desc->dir = NULL;
       /* GXY's code end */
-      list_push_back(&(p_desc->opened_files), &(f_desc->elem));
+      f_desc->id = desc_table_add(&(p_desc->opened_files), f_desc);
+      if (f_desc->id == -1) {
+        if (f_desc->dir) dir_close(f_desc->dir);
+        file_close (opened_file);
+        free (f_desc);
+      }
       return_value = f_desc->id;
     }
   }
-  lock_release (&syscall_filesys_lock);
   return return_value;
 } 
 /* GLS's code end */
@@ -409,9 +461,7 @@ syscall_filesize (int fd) {
   struct thread *current_thread = thread_current();
   struct file_descriptor* f_desc = find_file (current_thread, fd);
   if (f_desc != NULL) {
-    lock_acquire (&syscall_filesys_lock);
     return_value = file_length(f_desc->file);
-    lock_release (&syscall_filesys_lock);
   }
 
   return return_value;
@@ -428,20 +478,27 @@ syscall_read (int fd, void *buffer, off_t size) {
     // printf("[Error] read(): fd is STDOUT_FILEON\n.");
   }
   else if (fd == SYSCALL_STDIN_FILENO) {
-    int i;
-    for (i = 0; i < size; ++i) {
-    //  printf ("put_user\n");
-      put_user ((uint8_t*) buffer + i, input_getc());
-      return_value = i + 1;
+    /* GXY's code begin */
+    // gather keys in a kernel buffer and copy them out a chunk at a time
+    uint8_t keys[64];
+    off_t done = 0;
+    while (done < size) {
+      off_t chunk = size - done < (off_t) sizeof keys ? size - done : (off_t) sizeof keys;
+      off_t i;
+      for (i = 0; i < chunk; ++i)
+        keys[i] = input_getc();
+      copy_to_user ((uint8_t*) buffer + done, keys, chunk);
+      done += chunk;
     }
+    if (done > 0)
+      return_value = done;
+    /* GXY's code end */
   }
   else {
     struct thread *current_thread = thread_current();
     struct file_descriptor* f_desc = find_file(current_thread, fd);
     if (f_desc != NULL) {
-      lock_acquire (&syscall_filesys_lock);
-      return_value = file_read (f_desc->file, buffer, size);
-      lock_release (&syscall_filesys_lock);
+      return_value = file_io_user (f_desc->file, buffer, size, false, NULL);
     }
   }
 
@@ -458,16 +515,27 @@ syscall_write (int fd, const void *buffer, off_t size) {
     // printf("[Error] write(): fd is STDIN_FILEON\n.");
   }
   else if (fd == SYSCALL_STDOUT_FILENO) {
-    putbuf(buffer, (size_t) size);
+    /* old code begin */
+    // putbuf(buffer, (size_t) size);
+    /* old code end */
+    /* GXY's code begin */
+    // putbuf holds the console lock, so user memory that faults
+    // is copied in first, a chunk at a time
+    uint8_t chunk[STDOUT_CHUNK_SIZE];
+    off_t written;
+    for (written = 0; written < size; written += STDOUT_CHUNK_SIZE) {
+      size_t n = size - written < STDOUT_CHUNK_SIZE ? size - written : STDOUT_CHUNK_SIZE;
+      copy_from_user (chunk, (const uint8_t*) buffer + written, n);
+      putbuf ((const char*) chunk, n);
+    }
+    /* GXY's code end */
     return_value = size;
   }
   else {
     struct thread *current_thread = thread_current();
     struct file_descriptor* f_desc = find_file(current_thread, fd);
     if (f_desc != NULL) {
-      lock_acquire (&syscall_filesys_lock);
-      return_value = file_write (f_desc->file, buffer, size);
-      lock_release (&syscall_filesys_lock);
+      return_value = file_io_user (f_desc->file, (void*) buffer, size, true, NULL);
     }
   }
   return return_value;
@@ -475,6 +543,160 @@ syscall_write (int fd, const void *buffer, off_t size) {
 /* GLS's code end */
 
 
+/* GXY's code begin */
+// Reads SIZE bytes at POSITION of the file open as FD into BUFFER,
+// without moving the file position.
+static int
+syscall_pread (int fd, void *buffer, off_t size, off_t position) {
+  struct file_descriptor* f_desc = find_file (thread_current (), fd);
+  if (f_desc == NULL || position < 0)
+    return -1;
+  return file_io_user (f_desc->file, buffer, size, false, &position);
+}
+
+// Writes SIZE bytes from BUFFER at POSITION of the file open as FD,
+// without moving the file position.
+static int
+syscall_pwrite (int fd, const void *buffer, off_t size, off_t position) {
+  struct file_descriptor* f_desc = find_file (thread_current (), fd);
+  if (f_desc == NULL || position < 0)
+    return -1;
+  return file_io_user (f_desc->file, (void*) buffer, size, true, &position);
+}
+
+// Reads into (or, when WRITE, writes from) the IOVCNT buffers described
+// by the user array UIOV in order, as one read or write at the file
+// position.  Stops at the first short transfer and returns the bytes
+// transferred, or -1 on a bad descriptor or count.
+static int
+syscall_rwv (int fd, const struct iovec *uiov, int iovcnt, bool write) {
+  struct iovec iov[IOV_MAX];
+  off_t total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  copy_from_user (iov, uiov, iovcnt * sizeof *iov);
+  for (i = 0; i < iovcnt; i++) {
+    if ((off_t) iov[i].iov_len < 0 || (off_t) iov[i].iov_len > INT32_MAX - total)
+      return -1;
+    total += iov[i].iov_len;
+    if (iov[i].iov_len > 0 && !is_valid_user_buffer (iov[i].iov_base, iov[i].iov_len))
+      return -1;
+  }
+
+  struct file_descriptor* f_desc = NULL;
+  if (fd != SYSCALL_STDIN_FILENO && fd != SYSCALL_STDOUT_FILENO) {
+    f_desc = find_file (thread_current (), fd);
+    if (f_desc == NULL)
+      return -1;
+  }
+  total = 0;
+  for (i = 0; i < iovcnt; i++) {
+    off_t n;
+    if (iov[i].iov_len == 0)
+      continue;
+    if (f_desc != NULL)
+      n = file_io_user (f_desc->file, iov[i].iov_base, iov[i].iov_len, write, NULL);
+    else if (write)
+      n = syscall_write (fd, iov[i].iov_base, iov[i].iov_len);
+    else
+      n = syscall_read (fd, iov[i].iov_base, iov[i].iov_len);
+    if (n < 0)
+      return total > 0 ? total : -1;
+    total += n;
+    if (n < (off_t) iov[i].iov_len)
+      break;
+  }
+  return total;
+}
+
+// Copies SIZE bytes from the file open as FD_IN to the one open as FD_OUT,
+// at and advancing both positions, without passing through user memory.
+static int
+syscall_copy_file_range (int fd_in, int fd_out, off_t size) {
+  struct thread *current_thread = thread_current ();
+  struct file_descriptor* in = find_file (current_thread, fd_in);
+  struct file_descriptor* out = find_file (current_thread, fd_out);
+  if (in == NULL || out == NULL || size < 0)
+    return -1;
+  return file_copy (out->file, in->file, size);
+}
+
+// Runs one submission read from a ring, as its system call would.
+static int
+ring_dispatch (const struct ring_sqe *sqe) {
+  int result = -1;
+  char *name;
+
+  switch (sqe->op) {
+  case RING_NOP:
+    return 0;
+  case RING_CLOSE:
+    syscall_close (sqe->fd);
+    return 0;
+  case RING_READ:
+    if (is_valid_user_buffer (sqe->addr, sqe->len))
+      result = syscall_read (sqe->fd, sqe->addr, sqe->len);
+    return result;
+  case RING_WRITE:
+    if (is_valid_user_buffer (sqe->addr, sqe->len))
+      result = syscall_write (sqe->fd, sqe->addr, sqe->len);
+    return result;
+  case RING_CREATE:
+  case RING_REMOVE:
+  case RING_OPEN:
+  case RING_MKDIR:
+    name = copy_in_string (sqe->addr);
+    if (name == NULL)
+      return -1;
+    if (sqe->op == RING_CREATE)
+      result = syscall_create (name, sqe->len);
+    else if (sqe->op == RING_REMOVE)
+      result = syscall_remove (name);
+    else if (sqe->op == RING_OPEN)
+      result = syscall_open (name);
+    else
+      result = strlen (name) != 0 && syscall_mkdir (name);
+    palloc_free_page (name);
+    return result;
+  default:
+    return -1;
+  }
+}
+
+// Runs the submissions queued in the user ring URING in order, posting a
+// completion for each, until the submission queue is empty, the
+// completion queue is full or RING_ENTRIES have run.  Returns the number
+// of submissions run.
+static int
+syscall_ring_enter (struct ring *uring) {
+  unsigned sq_head, sq_tail, cq_head, cq_tail;
+  struct ring_sqe sqe;
+  struct ring_cqe cqe;
+  int done = 0;
+
+  copy_from_user (&sq_head, &uring->sq_head, sizeof sq_head);
+  copy_from_user (&sq_tail, &uring->sq_tail, sizeof sq_tail);
+  copy_from_user (&cq_head, &uring->cq_head, sizeof cq_head);
+  copy_from_user (&cq_tail, &uring->cq_tail, sizeof cq_tail);
+  while (sq_head != sq_tail && cq_tail - cq_head < RING_ENTRIES
+         && done < RING_ENTRIES) {
+    copy_from_user (&sqe, &uring->sq[sq_head % RING_ENTRIES], sizeof sqe);
+    cqe.user_data = sqe.user_data;
+    cqe.result = ring_dispatch (&sqe);
+    copy_to_user (&uring->cq[cq_tail % RING_ENTRIES], &cqe, sizeof cqe);
+    sq_head++;
+    cq_tail++;
+    done++;
+  }
+  copy_to_user (&uring->sq_head, &sq_head, sizeof sq_head);
+  copy_to_user (&uring->cq_tail, &cq_tail, sizeof cq_tail);
+  return done;
+}
+/* GXY's code end */
+
+
 /* GLS's code begin */
 static void 
 syscall_seek (int fd, off_t position) {
@@ -485,9 +707,7 @@ syscall_seek (int fd, off_t position) {
     struct thread *current_thread = thread_current();
     struct file_descriptor* f_desc = find_file(current_thread, fd);
     if (f_desc != NULL) {
-      lock_acquire (&syscall_filesys_lock);
       file_seek (f_desc->file, position);
-      lock_release (&syscall_filesys_lock);
     }
   }
 }
@@ -505,9 +725,7 @@ syscall_tell (int fd) {
     struct thread *current_thread = thread_current();
     struct file_descriptor* f_desc = find_file(current_thread, fd);
     if (f_desc != NULL) {
-      lock_acquire (&syscall_filesys_lock);
       return_value = file_tell (f_desc->file);
-      lock_release (&syscall_filesys_lock);
     }
   }
   return return_value;
@@ -520,10 +738,9 @@ syscall_tell (int fd) {
 void 
 syscall_close_file (struct file_descriptor *f_desc) {
   if (f_desc != NULL) {
-    lock_acquire (&syscall_filesys_lock);
+    if (f_desc->dir) dir_close(f_desc->dir);
     file_close (f_desc->file);
-    palloc_free_page (f_desc);
-    lock_release (&syscall_filesys_lock);
+    free (f_desc);
   }
 }
 /* GLS's code end */
@@ -539,14 +756,12 @@ syscall_close (int fd) {
     struct thread *current_thread = thread_current();
     struct file_descriptor* f_desc = find_file(current_thread, fd);
     if (f_desc != NULL) {
-      lock_acquire (&syscall_filesys_lock);
       /* GXY's code begin */
       if (f_desc->dir) dir_close(f_desc->dir);
       /* GXY's code end */
       file_close (f_desc->file);
-      list_remove(&(f_desc->elem));
-      palloc_free_page (f_desc);
-      lock_release (&syscall_filesys_lock);
+      desc_table_remove(&(current_thread->p_desc->opened_files), fd);
+      free (f_desc);
     }
   }
 }
@@ -556,59 +771,8 @@ syscall_close (int fd) {
 /* GLS's code begin */
 static struct file_descriptor*
 find_file (struct thread *t, fid_t fd) {
-  if (fd < 2) /* STDIN_FILEON or STDOUT_FILEON */
-    return NULL;
-  struct list *opened_files = &(t->p_desc->opened_files);
-  struct list_elem *file_elem = NULL;
-  for (file_elem = list_begin (opened_files); file_elem != list_end (opened_files); 
-    file_elem = list_next (file_elem)) {
-      struct file_descriptor* tmp = list_entry (file_elem, struct file_descriptor, elem);
-      if (tmp->id == fd) {
-        return tmp;
-      } 
-    }
-  return NULL;
-}
-/* GLS's code end */
-
-
-/* GLS's code begin */
-static void
-read_user (void *uaddr, void *dest, unsigned size) {
-  unsigned i;
-  for (i = 0; i < size; ++i) {
-    *((uint8_t*) dest + i) = get_user(uaddr + i) & 0xff;
-  }
-} 
-/* GLS's code end */
-
-
-/* GLS's code begin */
-/* The following code is provided by the 
-4.1.5(Accessing User Memory)  in the document of pintos.*/
-
-/* Reads a byte at user virutal address UADDR. */
-static int
-get_user (const uint8_t *uaddr) {
-  if (is_valid_uaddr((void*) uaddr)) {
-    int res;
-    asm ("movl $1f, %0; movzbl %1, %0; 1:"
-        : "=&a" (res) : "m" (*uaddr));
-    return res;
-  }
-  return 0;
-}
-
-/* Writes BYTE to user virtual address UDST. */
-static bool
-put_user (uint8_t *udst, uint8_t byte) {
-  if (is_valid_uaddr((void*) udst)) {
-    int error_code;
-    asm ("movl $1f, %0; movb %b2, %1; 1:"
-        : "=&a" (error_code), "=m" (*udst) : "q" (byte));
-    return error_code != -1;
-  }
-  return false;
+  /* STDIN_FILEON and STDOUT_FILEON are below the table's base. */
+  return desc_table_get (&(t->p_desc->opened_files), fd);
 }
 /* GLS's code end */
 
@@ -645,45 +809,158 @@ is_valid_uaddr (void *uaddr) {
 
 /* GLS's code begin */
 static bool 
-is_valid_user_string (const char *str) {
-  if (!is_valid_uaddr ((void*) str))
+is_valid_user_buffer (const void* buffer, off_t size) {
+  if (!is_valid_uaddr ((void*) buffer))
     return false;
-  unsigned i = 0;
-  while (*(str + i) != '\0') {
-    ++i;
-    if (((int) (str + i) & PGMASK) == 0 && !is_valid_uaddr ((void*) str + i)) {
-      /* only need to check the beginning of a page. */
+  /* GXY's code begin */
+  // only the first byte of every later page needs a check
+  off_t i;
+  for (i = PGSIZE - pg_ofs (buffer); i < size; i += PGSIZE) {
+    if (!is_valid_uaddr ((void*) buffer + i)) {
       return false;
     }
   }
+  /* GXY's code end */
   return true;
 }
 /* GLS's code end */
 
 
-/* GLS's code begin */
-static bool 
-is_valid_user_buffer (const void* buffer, off_t size) {
-  if (!is_valid_uaddr ((void*) buffer))
-    return false;
-  int i;
-  for (i = 1; i < size; ++i) {
-    if ((((int) buffer + i) & PGMASK) == 0 && !is_valid_uaddr ((void*) buffer + i)) {
-      return false;
-    }
+/* GXY's code begin */
+// Copies SIZE bytes from SRC to DST with string moves, a word at a time
+// and then the remaining bytes.
+static inline void
+copy_bytes (void *dst, const void *src, size_t size) {
+  int ecx, edi, esi;
+  asm volatile ("rep movsl\n\t"
+                "movl %4, %%ecx\n\t"
+                "rep movsb"
+                : "=&c" (ecx), "=&D" (edi), "=&S" (esi)
+                : "0" (size / 4), "g" (size & 3), "1" (dst), "2" (src)
+                : "memory");
+}
+
+// Copies SIZE bytes from user address USRC to kernel buffer DST.
+// Each user page is looked up once and then copied whole.  A bad address
+// kills the process, so this only returns once everything is copied.
+// A page evicted after the check is faulted back in by the page fault
+// handler.
+static void
+copy_from_user (void *dst, const void *usrc, size_t size) {
+  while (size > 0) {
+    size_t chunk = PGSIZE - pg_ofs (usrc);
+    if (chunk > size)
+      chunk = size;
+    is_valid_uaddr ((void*) usrc);
+    copy_bytes (dst, usrc, chunk);
+    dst = (uint8_t*) dst + chunk;
+    usrc = (const uint8_t*) usrc + chunk;
+    size -= chunk;
   }
-  return true;
 }
-/* GLS's code end */
+
+// Copies SIZE bytes from kernel buffer SRC to user address UDST,
+// checking each user page once.  A bad address kills the process.
+static void
+copy_to_user (void *udst, const void *src, size_t size) {
+  while (size > 0) {
+    size_t chunk = PGSIZE - pg_ofs (udst);
+    if (chunk > size)
+      chunk = size;
+    is_valid_uaddr (udst);
+    copy_bytes (udst, src, chunk);
+    udst = (uint8_t*) udst + chunk;
+    src = (const uint8_t*) src + chunk;
+    size -= chunk;
+  }
+}
+
+// Returns the length of the string at user address USTR, or SIZE if
+// there is no null terminator in its first SIZE bytes.  Each user page
+// is checked once; a bad address kills the process.
+static size_t
+strnlen_user (const char *ustr, size_t size) {
+  size_t len = 0;
+  while (len < size) {
+    size_t chunk = PGSIZE - pg_ofs (ustr + len);
+    if (chunk > size - len)
+      chunk = size - len;
+    is_valid_uaddr ((void*) ustr + len);
+    // the page is mapped, so look for the terminator without more checks
+    for (; chunk > 0; chunk--, len++)
+      if (ustr[len] == '\0')
+        return len;
+  }
+  return size;
+}
+
+#ifdef VM
+// Pages pinned at once by file_io_user(), so that a large buffer cannot
+// pin more frames than the user pool can spare.
+#define PIN_PAGES 16
+#endif
+
+// Reads or writes SIZE bytes of FILE at the file position, or at *OFS
+// when OFS is not null, and then advances *OFS.
+static off_t
+file_io (struct file *file, void *buffer, off_t size, bool write, off_t *ofs) {
+  if (ofs == NULL)
+    return write ? file_write (file, buffer, size) : file_read (file, buffer, size);
+  off_t n = write ? file_write_at (file, buffer, size, *ofs)
+                  : file_read_at (file, buffer, size, *ofs);
+  *ofs += n;
+  return n;
+}
+
+// Reads SIZE bytes of FILE into user BUFFER, or writes them from it when
+// WRITE, as file_io() does.  Under VM the buffer is pinned PIN_PAGES pages at a time so the
+// file system copies straight between the cache and user pages and never
+// faults (or evicts to a file) in the middle of it.
+static off_t
+file_io_user (struct file *file, void *buffer, off_t size, bool write, off_t *ofs) {
+#ifdef VM
+  off_t done = 0;
+  while (done < size) {
+    uint8_t *chunk_start = (uint8_t*) buffer + done;
+    off_t chunk = PIN_PAGES * PGSIZE - pg_ofs (chunk_start);
+    if (chunk > size - done)
+      chunk = size - done;
+    // reading from the file writes into the buffer
+    if (!page_pin_buffer (chunk_start, chunk, !write))
+      exit_forcely ();
+    off_t n = file_io (file, chunk_start, chunk, write, ofs);
+    page_unpin_buffer (chunk_start, chunk);
+    done += n;
+    if (n < chunk)
+      break;
+  }
+  return done;
+#else
+  return file_io (file, buffer, size, write, ofs);
+#endif
+}
+
+// Returns a copy of the user string USTR in a new page, which the caller
+// frees with palloc_free_page(), or a null pointer if it does not fit.
+// The string is checked before the page is allocated, so a bad address
+// kills the process without leaking it.
+static char *
+copy_in_string (const char *ustr) {
+  size_t len = strnlen_user (ustr, PGSIZE);
+  if (len == PGSIZE)
+    return NULL;
+  char *kstr = palloc_get_page (0);
+  if (kstr != NULL)
+    copy_from_user (kstr, ustr, len + 1);
+  return kstr;
+}
+/* GXY's code end */
 
 
 /* GLS's code begin */
-/* release the filesys lock and exit with -1. */
+/* exit with -1. */
 void 
 exit_forcely (void) {
-  if (lock_held_by_current_thread (&syscall_filesys_lock)) {
-    lock_release (&syscall_filesys_lock);
-  }
   syscall_exit (-1);    
 }
 /* GLS's code end */
@@ -754,7 +1031,13 @@ syscall_readdir(int fd, void* buffer) {
   struct file_descriptor* f_desc = find_file(current_thread, fd);
 
   if (f_desc != NULL && is_dirfile(f_desc)) {
-    return dir_readdir(f_desc->dir, buffer);
+    /* GXY's code begin */
+    char name[READDIR_MAX_LEN + 1];
+    if (!dir_readdir(f_desc->dir, name))
+      return false;
+    copy_to_user(buffer, name, strlen(name) + 1);
+    return true;
+    /* GXY's code end */
   } else {
     return false;
   }
@@ -815,8 +1098,6 @@ syscall_mmap (int fd, void* addr) {
     return -1;
   }
 
-  lock_acquire (&syscall_filesys_lock);  
-
   struct thread *current_thread = thread_current();
   struct file_descriptor *file_d = find_file (current_thread, fd);
   struct file* reopened_file = NULL;
@@ -828,7 +1109,6 @@ syscall_mmap (int fd, void* addr) {
     }
   }
   if (file_d == NULL || file_d->file == NULL || reopened_file == NULL || file_bytes == 0) {
-   lock_release (&syscall_filesys_lock);
     return -1;  
   }
 
@@ -836,7 +1116,6 @@ syscall_mmap (int fd, void* addr) {
   page_table_type *page_table = current_thread->page_table;
   if (page_available_mmap (page_table, page_num, addr)) {
     struct mmap_file *mmap_f = malloc (sizeof (struct mmap_file));
-    mmap_f->id = current_thread->mmap_count++;
     mmap_f->addr = addr;
     mmap_f->file = reopened_file;
     mmap_f->file_bytes = file_bytes;
@@ -845,16 +1124,17 @@ syscall_mmap (int fd, void* addr) {
     mmap_f->writable = true;
     mmap_f->static_data = false;
     if (page_install_mmap (page_table, page_num, mmap_f)) {
-      list_push_back (&(current_thread->mmap_list), &(mmap_f->elem));
-      lock_release (&syscall_filesys_lock);
-      return mmap_f->id;
+      mmapid_t id = desc_table_add (&(current_thread->mmap_table), mmap_f);
+      mmap_f->id = id;
+      if (id == -1)
+        syscall_munmap_file (mmap_f);
+      return id;
     }
     else {
       free (mmap_f);
     }
   }
 
-  lock_release (&syscall_filesys_lock);
   return -1;
 }
 /* GLS's code end */
@@ -864,18 +1144,15 @@ syscall_mmap (int fd, void* addr) {
 static void
 syscall_munmap(mmapid_t id) {
   struct thread *current_thread = thread_current();
-  struct mmap_file *mmap_f = find_mmap_file (current_thread, id);
+  struct mmap_file *mmap_f = desc_table_remove (&(current_thread->mmap_table), id);
   if (mmap_f != NULL) {
-   lock_acquire (&syscall_filesys_lock);
     int i, page_num = (mmap_f->file_bytes + mmap_f->zero_bytes + PGSIZE - 1) / PGSIZE;
     void *addr = mmap_f->addr;  
     for (i = 0; i < page_num; ++i, addr += PGSIZE) {
       page_table_unstall_file(current_thread->page_table, addr);
     }
     file_close (mmap_f->file);
-    list_remove(&(mmap_f->elem));
     free (mmap_f);
-   lock_release (&syscall_filesys_lock);
   }
 }
 /* GLS's code end */
@@ -885,7 +1162,6 @@ syscall_munmap(mmapid_t id) {
 void
 syscall_munmap_file(struct mmap_file *mmap_f) {
   struct thread* current_thread = thread_current();
-  lock_acquire (&syscall_filesys_lock);
   int i, page_num = (mmap_f->file_bytes + mmap_f->zero_bytes + PGSIZE - 1) / PGSIZE;
   void *addr = mmap_f->addr;  
   for (i = 0; i < page_num; ++i, addr += PGSIZE) {
@@ -893,9 +1169,7 @@ syscall_munmap_file(struct mmap_file *mmap_f) {
   }
   if (mmap_f->file != current_thread->p_desc->own_file)
    file_close (mmap_f->file);
-  list_remove(&(mmap_f->elem));
   free (mmap_f);
-  lock_release (&syscall_filesys_lock);
 }
 /* GLS's code end */
 
@@ -905,9 +1179,6 @@ void
 read_page_from_file (struct mmap_file *mmap_f, void *upage, void *kpage) {
   void *file_end = mmap_f->addr + mmap_f->file_bytes;
   void *zero_end = file_end + mmap_f->zero_bytes;
- //bool held = lock_held_by_current_thread (&syscall_filesys_lock);
- //if (!held)
- //  lock_acquire (&syscall_filesys_lock);
   if (upage < file_end) {
     if (file_end - upage < PGSIZE) {
       /* read page from the last page of file. */
@@ -924,8 +1195,6 @@ read_page_from_file (struct mmap_file *mmap_f, void *upage, void *kpage) {
       memset (kpage, 0, PGSIZE);
     }
   }
- // if (!held)
- //  lock_release (&syscall_filesys_lock);
 }
 /* GLS's code end */
 
@@ -934,9 +1203,6 @@ read_page_from_file (struct mmap_file *mmap_f, void *upage, void *kpage) {
 void write_page_to_file (struct mmap_file *mmap_f, void *upage, void *kpage) {
   if (mmap_f->writable) {
     void *file_end = mmap_f->addr + mmap_f->file_bytes;
-   //bool held = lock_held_by_current_thread (&syscall_filesys_lock);
-   //if (!held)
-   //  lock_acquire (&syscall_filesys_lock);
     if (upage < file_end) {
       if (file_end - upage < PGSIZE) {
         /* read page from the last page of file. */
@@ -947,26 +1213,7 @@ void write_page_to_file (struct mmap_file *mmap_f, void *upage, void *kpage) {
         file_write_at (mmap_f->file, kpage, PGSIZE, mmap_f->ofs + upage - mmap_f->addr);
       }
     } 
-     //if (!held)
-     // lock_release (&syscall_filesys_lock);
   }
 }
 /* GLS's code end */
-
-
-/* GLS's code begin */
-static struct mmap_file* 
-find_mmap_file (struct thread *t, mmapid_t id) {
-  struct list *mmap_list = &(t->mmap_list);
-  struct list_elem *mmap_elem = NULL;
-  for (mmap_elem = list_begin (mmap_list); mmap_elem != list_end (mmap_list); 
-    mmap_elem  = list_next (mmap_elem)) {
-      struct mmap_file* tmp = list_entry (mmap_elem, struct mmap_file, elem);
-      if (tmp->id == id) {
-        return tmp;
-      } 
-    }
-  return NULL;
-}
 #endif
-/* GLS's code end */
@@ -14,7 +14,6 @@ typedef int fid_t;
 struct file_descriptor {
     fid_t id;
     struct file *file;
-    struct list_elem elem;
     
     /* yy's code begin */
     struct dir* dir;
@@ -37,7 +36,6 @@ struct mmap_file {
     uint32_t ofs;
     bool writable;
     bool static_data;
-    struct list_elem elem;
 };
 
 void syscall_munmap_file (struct mmap_file *mmap_f);
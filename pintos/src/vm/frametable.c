@@ -16,39 +16,46 @@
 
 /*FLY's code begin*/
 
-/* all user process pages are saved in the frame_table*/
-static struct hash frame_table;
-/* those frames to be substituted*/
-static struct list frame_clock;
+/* all user process pages are saved in the frame_table,
+   one node for each page of the user pool */
+static struct frame_table_node* frame_table;
+static size_t frame_cnt;
+static uint8_t* user_pool_base;
+/* frames that can be substituted are the in_use ones not referenced or pinned */
+static size_t frame_clock_cnt;
 static struct lock frame_lock;
-struct frame_table_node*  clock_hand;
+static size_t clock_hand;
 
 
-unsigned frame_table_hash (const struct hash_elem *e, void *aux);
-bool frame_table_hash_less (const struct hash_elem *a, const struct hash_elem *b, void *aux);
-void* pick_frame_to_eviction(void);
-void frame_table_clock_hand_inc(void);
-void frame_table_clock_hand_dec(void);
+struct frame_table_node* pick_frame_to_eviction(void);
+static void frame_evict(struct thread* thr, void* upage, void* frame);
 
 
-/* find the frame in hash table*/
+/* find the node of a frame, NULL if it is not a user frame in use*/
 void* frame_search(void* frame){
-  struct frame_table_node to_search;
-  struct hash_elem * hash_node;
-  to_search.frame  = frame;
-  hash_node = hash_find(&frame_table, &(to_search.hash_node));
-  if(hash_node == NULL)
+  if((uint8_t*)frame < user_pool_base)
     return NULL;
-  return hash_entry(hash_node, struct frame_table_node, hash_node);
+  size_t index = ((uint8_t*)frame - user_pool_base) / PGSIZE;
+  if(index >= frame_cnt || !frame_table[index].in_use)
+    return NULL;
+  return frame_table + index;
 }
 
 
 /*initial the static frame table*/
 void frame_table_init(void){
-  hash_init(&frame_table, frame_table_hash, frame_table_hash_less,NULL);
-  list_init(&frame_clock);
+  user_pool_base = palloc_user_pool(&frame_cnt);
+  frame_table = malloc(frame_cnt * sizeof(struct frame_table_node));
+  if(frame_table == NULL)
+    PANIC("cannot allocate the frame table");
+  size_t i;
+  for(i = 0; i < frame_cnt; ++i){
+    frame_table[i].frame = user_pool_base + i * PGSIZE;
+    frame_table[i].in_use = false;
+  }
   lock_init(&frame_lock);
-  clock_hand = NULL;
+  frame_clock_cnt = 0;
+  clock_hand = 0;
 }
 
 
@@ -59,18 +66,10 @@ void frame_table_free_frame(void* frame){
   if(frame_to_free == NULL)
     PANIC("cannot find the frame to free~");
 
-  if(!frame_to_free->referenced){
-    if(clock_hand == frame_to_free){
-      if(list_size(&frame_clock) == 1){
-        clock_hand = NULL;
-      }
-      else frame_table_clock_hand_inc();
-    }
-    list_remove(&frame_to_free->list_node);
-  }
-
-  hash_delete(&frame_table, &(frame_to_free->hash_node));
-  free(frame_to_free);
+  if(!frame_to_free->referenced && frame_to_free->pin_cnt == 0)
+    frame_clock_cnt--;
+  frame_to_free->in_use = false;
+  frame_to_free->pin_cnt = 0;
   palloc_free_page(frame);
   lock_release(&frame_lock);
 }
@@ -79,9 +78,44 @@ void frame_table_free_frame(void* frame){
 /*get page from user pool*/
 void* frame_table_get_frame(enum palloc_flags flag, void* upage){
   lock_acquire(&frame_lock);
-  void* new_frame = palloc_get_page(PAL_USER | flag);
-  if(new_frame == NULL){
-    new_frame = pick_frame_to_eviction();
+  void* new_frame;
+  struct frame_table_node* victim = NULL;
+  while((new_frame = palloc_get_page(PAL_USER | flag)) == NULL){
+    victim = pick_frame_to_eviction();
+    if(victim != NULL)
+      break;
+    /* every evictable frame is in use by a busy process, let them go on */
+    lock_release(&frame_lock);
+    thread_yield();
+    lock_acquire(&frame_lock);
+  }
+
+  struct frame_table_node* item = victim;
+  struct thread* old_thr = NULL;
+  void* old_upage = NULL;
+  if(victim == NULL){
+    item = frame_table + ((uint8_t*)new_frame - user_pool_base) / PGSIZE;
+    ASSERT(!item->in_use);
+  }
+  else{
+    new_frame = victim->frame;
+    old_thr = victim->thr;
+    old_upage = victim->upage;
+  }
+  /* stays referenced, so the clock skips it until the new page is in it */
+  item->upage = upage;
+  item->thr = thread_current();
+  item->in_use = true;
+  item->referenced = true;
+  item->pin_cnt = 0;
+  lock_release(&frame_lock);
+
+  if(victim != NULL){
+    /* the disk I/O is done with only the owner's page table locked */
+    bool held = lock_held_by_current_thread(&old_thr->page_table_lock);
+    frame_evict(old_thr, old_upage, new_frame);
+    if(!held)
+      lock_release(&old_thr->page_table_lock);
     if(flag & PAL_ZERO) {// flag == pal_zero
       memset(new_frame,0,PGSIZE);
     }
@@ -89,18 +123,6 @@ void* frame_table_get_frame(enum palloc_flags flag, void* upage){
       PANIC("palloc assertion when getting frame in frame table.");
     }
   }
-  if(new_frame == NULL){
-    return NULL;
-  }
-
-  struct frame_table_node* item = (struct frame_table_node*) malloc(sizeof(struct frame_table_node));
-  item->frame = new_frame;
-  item->upage = upage;
-  item->thr = thread_current();
-  item->referenced = true;
-
-  hash_insert(&frame_table, &(item->hash_node));
-  lock_release(&frame_lock);
   return new_frame;
 }
 
@@ -118,91 +140,78 @@ bool frame_set_not_referenced(void* frame){
   }
 
   node->referenced = false;
-  
-  list_push_back(&frame_clock, &node->list_node);
-  if (list_size (&frame_clock) == 1) {
-    clock_hand = node;
-  }
+  if(node->pin_cnt == 0)
+    frame_clock_cnt++;
   
   lock_release(&frame_lock);
   return true;
 }
 
 
-/* use the replace strategy to get a frame */
-void* pick_frame_to_eviction(void){
-  ASSERT(clock_hand != NULL); //else we needn't to replace
-
-  /* find the page to be replaced */
-  while(pagedir_is_accessed(clock_hand->thr->pagedir,clock_hand->upage)){
-    pagedir_set_accessed(clock_hand->thr->pagedir,clock_hand->upage,false);
-    frame_table_clock_hand_inc();
-    ASSERT(clock_hand != NULL);
-  } 
-
-  struct frame_table_node *get_frame_node = clock_hand;
-  void* get_frame = get_frame_node->frame;
-  swap_index_t index = (swap_index_t)-1;
-  struct page_table_node* node = page_search(get_frame_node->thr->page_table, get_frame_node->upage);
+/* keep frame out of eviction until a matching frame_unpin,
+   the owner's page table lock must be held so it is not being evicted */
+void frame_pin(void* frame){
+  lock_acquire(&frame_lock);
+  struct frame_table_node* node = frame_search(frame);
   ASSERT(node != NULL);
-  if(node->mmap_f == NULL|| 
-  ((node->mmap_f))->static_data){
-    index = swap_in(get_frame_node->frame);
-   // // printf ("pick one to swap  %d\n", index);
-    ASSERT(evict_page_to_swap(get_frame_node->thr, get_frame_node->upage, index));
-  }
-  else{
-    write_page_to_file(node->mmap_f, get_frame_node->upage, get_frame);
-    ASSERT(evict_page_to_file(get_frame_node->thr,get_frame_node->upage));
-  }
-
-  list_remove(&get_frame_node->list_node);
-  if(list_empty(&frame_clock))
-    clock_hand = NULL;
-  else frame_table_clock_hand_inc();
-  hash_delete(&frame_table, &get_frame_node->hash_node);
-  free(get_frame_node);
-  return get_frame;
+  if(node->pin_cnt++ == 0 && !node->referenced)
+    frame_clock_cnt--;
+  lock_release(&frame_lock);
 }
 
 
-/*clock hand dec and inc */
-void frame_table_clock_hand_dec(void){//point to previous frame
-  ASSERT(clock_hand != NULL);
-  if(list_size(&frame_clock) == 1) return;
-  if(&clock_hand->list_node == list_front(&frame_clock)){
-    clock_hand = list_entry(
-      list_tail(&frame_clock),struct frame_table_node, list_node); //tail in a list does not contains data
-  }
-  clock_hand = list_entry(
-    list_prev(&clock_hand->list_node),struct frame_table_node, list_node);
+void frame_unpin(void* frame){
+  lock_acquire(&frame_lock);
+  struct frame_table_node* node = frame_search(frame);
+  ASSERT(node != NULL && node->pin_cnt > 0);
+  if(--node->pin_cnt == 0 && !node->referenced)
+    frame_clock_cnt++;
+  lock_release(&frame_lock);
 }
 
 
-void frame_table_clock_hand_inc(void){//point to next frame
-  ASSERT(clock_hand != NULL);
-  if(list_size(&frame_clock) == 1) return;
-  if(&clock_hand->list_node == list_back(&frame_clock)){
-    clock_hand = list_entry(
-      list_front(&frame_clock),struct frame_table_node, list_node); //tail in a list does not contains data
-    return;
+/* use the replace strategy to choose a frame, frame_lock must be held.
+   returns the frame node with the page table lock of its owner held,
+   or NULL if no frame can be evicted now */
+struct frame_table_node* pick_frame_to_eviction(void){
+  size_t step;
+  /* two rounds: the first may only clear accessed bits */
+  for(step = 0; step < 2 * frame_cnt && frame_clock_cnt > 0; ++step){
+    struct frame_table_node *node = frame_table + clock_hand;
+    clock_hand = (clock_hand + 1) % frame_cnt;
+    if(!node->in_use || node->referenced || node->pin_cnt > 0)
+      continue;
+    if(pagedir_is_accessed(node->thr->pagedir,node->upage)){
+      pagedir_set_accessed(node->thr->pagedir,node->upage,false);
+      continue;
+    }
+    /* never wait for another process here, it may be waiting for frame_lock */
+    if(!lock_held_by_current_thread(&node->thr->page_table_lock)
+       && !lock_try_acquire(&node->thr->page_table_lock))
+      continue;
+    frame_clock_cnt--;
+    return node;
   }
-  clock_hand = list_entry(
-    list_next(&clock_hand->list_node),struct frame_table_node, list_node);
-}
-
-
-/*hashtable util function*/
-unsigned frame_table_hash (const struct hash_elem *e, void *aux){
-  struct frame_table_node* node = hash_entry(e, struct frame_table_node, hash_node);
-  return hash_bytes(&node->frame, sizeof(node->frame));
+  return NULL;
 }
 
 
-bool frame_table_hash_less (const struct hash_elem *a, const struct hash_elem *b, void *aux){
-  struct frame_table_node* nodea = hash_entry(a, struct frame_table_node, hash_node);
-  struct frame_table_node* nodeb = hash_entry(b, struct frame_table_node, hash_node);
-  return nodea->frame < nodeb->frame;
+/* move the page of thr at upage out of frame to swap or its file,
+   thr's page table lock must be held */
+static void frame_evict(struct thread* thr, void* upage, void* frame){
+  struct page_table_node* node = page_search(thr->page_table, upage);
+  ASSERT(node != NULL);
+  /* from now on thr faults on the page, and waits for its page table lock */
+  pagedir_clear_page(thr->pagedir, upage);
+  if(node->mmap_f == NULL|| 
+  ((node->mmap_f))->static_data){
+    swap_index_t index = swap_in(frame);
+    ASSERT(evict_page_to_swap(thr, upage, index));
+  }
+  else{
+    write_page_to_file(node->mmap_f, upage, frame);
+    ASSERT(evict_page_to_file(thr, upage));
+  }
 }
 
 /*FLY's code end*/
\ No newline at end of file
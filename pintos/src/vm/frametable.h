@@ -7,21 +7,25 @@
 
 /*FLY's code begin*/
 
+/* one node per page of the user pool, indexed by (frame - user pool base) / PGSIZE */
 struct frame_table_node{
   void* frame; 
   void* upage;
   struct thread* thr; //entry belongs to which thread
-  bool referenced; /* referenced: this round will not be replaced */
-  struct hash_elem hash_node;
-  struct list_elem list_node;
+  bool in_use; /* frame is allocated to a user page */
+  bool referenced; /* referenced: this round will not be replaced, also pins
+                     the frame while its page is read in or evicted */
+  int pin_cnt; /* pinned by system calls doing I/O on the page, never evicted */
 };
-/* replacement strategy: clock*/
+/* replacement strategy: clock over the node array*/
 
 void frame_table_init(void);//init in thread_init
 void* frame_table_get_frame(enum palloc_flags flag, void* upage);
 void frame_table_free_frame(void* frame);
 void* frame_search(void* frame);
 bool frame_set_not_referenced(void* frame);
+void frame_pin(void* frame);
+void frame_unpin(void* frame);
 
 /*FLY's code end*/
 #endif
\ No newline at end of file
@@ -23,11 +23,12 @@ void page_table_destroy_frames (struct hash_elem *e, void *aux);
 
 
 /*FLY's code begin */
-static struct lock page_table_lock;
-void page_table_lock_init(void){
-  //printf ("# page_table_lock_init.\n");
-  lock_init(&page_table_lock);
- // printf ("lock_init %d %d\n", page_table_lock.semaphore.value, list_size(&(page_table_lock.semaphore.waiters)));
+
+/* every process locks its own page table with thread->page_table_lock,
+   so page faults of different processes run concurrently.
+   the evictor only try-acquires the lock of another process. */
+static struct lock* page_table_lock(void){
+  return &thread_current()->page_table_lock;
 }
 
 
@@ -38,31 +39,27 @@ page_table_type *page_table_create(void){
   //if (page_table_lock.holder != NULL)
   //printf ("lock_holder %d\n", (page_table_lock.holder)->tid);
  
-  lock_acquire(&page_table_lock);
   page_table_type *table = malloc(sizeof(page_table_type));
   if(table != NULL){
     if(hash_init(table, page_table_hash , page_table_less, NULL)) {
-      lock_release(&page_table_lock);
       return table;
     }
     else {
       free(table);
-      lock_release(&page_table_lock);
       return NULL;
     }
   }
-  lock_release(&page_table_lock);
   return NULL;
 }
 
 
 void page_table_destroy(page_table_type* page_table){
  // printf ("# page_table_destory.\n");
-  lock_acquire(&page_table_lock);
+  lock_acquire(page_table_lock());
  // printf ("page_table_destroy:%0x\n", page_table);
   hash_destroy(page_table, page_table_destroy_frames);
  // printf ("hash_destroy end.\n");
-  lock_release(&page_table_lock);
+  lock_release(page_table_lock());
   //printf ("page_table_destroy end.\n");
 }
 
@@ -85,9 +82,9 @@ struct page_table_node* page_search(page_table_type* page_table, void* upage){
 
 struct page_table_node* page_search_with_lock(page_table_type* page_table, void* upage){
   //printf ("# page_search_with_lock.\n");
-  lock_acquire(&page_table_lock);
+  lock_acquire(page_table_lock());
   struct page_table_node* res = page_search(page_table,upage);
-  lock_release(&page_table_lock);
+  lock_release(page_table_lock());
   return res;
 }
 
@@ -105,7 +102,7 @@ bool page_table_install_frame(void* upage, void* kpage, bool writable){
   
   bool success = false;
 
-  lock_acquire(&page_table_lock);
+  lock_acquire(page_table_lock());
   struct page_table_node* node = page_search(page_table, upage);
   if(node == NULL){
     node = malloc(sizeof(*node));
@@ -118,7 +115,7 @@ bool page_table_install_frame(void* upage, void* kpage, bool writable){
     hash_insert(page_table,&(node->hash_node));
     success = true;
   }
-  lock_release(&page_table_lock);
+  lock_release(page_table_lock());
   if(success){
     uint32_t* pagedir = thr->pagedir;
     ASSERT(pagedir_set_page(pagedir, upage, kpage, writable));
@@ -136,7 +133,7 @@ bool page_table_install_file(page_table_type *page_table, struct mmap_file *mmap
  // if (page_table_lock.holder != NULL)
  // printf ("lock_holder %d\n", (page_table_lock.holder)->tid);
   //printf ("waiter %d %d\n", page_table_lock.semaphore.value, list_size(&(page_table_lock.semaphore.waiters)));
-  lock_acquire(&page_table_lock);
+  lock_acquire(page_table_lock());
   //printf("install lock_acquire\n");
   if(page_table_available(page_table,upage)){
     struct page_table_node *node =  malloc(sizeof(struct page_table_node));
@@ -153,7 +150,7 @@ bool page_table_install_file(page_table_type *page_table, struct mmap_file *mmap
     //printf("hash_insert end.\n");
     success = true;
   }
-  lock_release(&page_table_lock);
+  lock_release(page_table_lock());
   //printf("install lock_release %d\n", (page_table_lock.holder));
   return success;
 }
@@ -163,7 +160,7 @@ bool page_table_unstall_file(page_table_type *page_table, void *upage){
 ///  printf ("page_table_unstall_file.\n");
   struct thread *thr = thread_current();
   bool success = false;
-  lock_acquire(&page_table_lock);
+  lock_acquire(page_table_lock());
   if(page_table_accessible(page_table,upage)){
     struct page_table_node *node = page_search(page_table,upage);
     ASSERT(node != NULL);
@@ -184,7 +181,7 @@ bool page_table_unstall_file(page_table_type *page_table, void *upage){
       success = true;
     }
   }
-  lock_release(&page_table_lock);
+  lock_release(page_table_lock());
   return success;
 }
 
@@ -251,15 +248,13 @@ bool page_fault_handler(const void* vaddr, bool write, void* esp){
   void* upage = pg_round_down(vaddr);/*virtual page number*/
 
   //printf ("page_fault_handler %x %x %x\n", vaddr, table, upage);
-  lock_acquire(&page_table_lock);
+  lock_acquire(page_table_lock());
   //printf ("page_search begin.\n");
   struct page_table_node *node = page_search(table, upage);//node in page table
   //printf ("page_search end  %x\n", node);
-  
-  ASSERT(!(node != NULL && node->status == Frame));//in frame won't occur page fault
 
   if(write == true && node != NULL && node->writable == false){  // permission conflict
-    lock_release (&page_table_lock);
+    lock_release (page_table_lock());
    // printf ("page_fault_handler end  %d\n", (page_table_lock.holder));
     return false;
   }
@@ -268,7 +263,11 @@ bool page_fault_handler(const void* vaddr, bool write, void* esp){
 
 //printf ("before success.\n");
   bool success = false;
-  if(upage >= STACK_BOTTOM_LINE){ 
+  if(node != NULL && node->status == Frame){
+    /* already resident, e.g. brought back while we waited for the lock */
+    success = true;
+  }
+  else if(upage >= STACK_BOTTOM_LINE){ 
   //  printf ("up stack.\n");
     if(vaddr >= esp - INST_LENGTH) {//else it is  a invalid address
       if(node == NULL){
@@ -326,17 +325,78 @@ bool page_fault_handler(const void* vaddr, bool write, void* esp){
     }
   }
 
+  /* map the page before the frame can be chosen for eviction */
+  if(success && pagedir_get_page(pagedir, node->key) == NULL) {
+    pagedir_set_page(pagedir,node->key,node->value,node->writable);
+  }
   frame_set_not_referenced(frame);
-  lock_release(&page_table_lock);
+  lock_release(page_table_lock());
 
  // printf ("page_fault_handler end  %d\n", (page_table_lock.holder));
-  if(success) {
-    pagedir_set_page(pagedir,node->key,node->value,node->writable);
-  }
   return success;
 }
 
 
+/* fault in the page at upage if needed and pin its frame,
+   false if it is not a valid user page (or not writable when write) */
+static bool page_pin(void* upage, bool write){
+  struct thread *cur_thread = thread_current();
+  for(;;){
+    lock_acquire(page_table_lock());
+    struct page_table_node *node = page_search(cur_thread->page_table, upage);
+    if(node != NULL && write && !node->writable){
+      lock_release(page_table_lock());
+      return false;
+    }
+    if(node != NULL && node->status == Frame){
+      /* evictors of our frames need our page table lock, so it stays */
+      frame_pin(node->value);
+      lock_release(page_table_lock());
+      return true;
+    }
+    lock_release(page_table_lock());
+    /* the page may be evicted again before we lock, then retry */
+    if(!page_fault_handler(upage, write, cur_thread->current_esp))
+      return false;
+  }
+}
+
+
+static void page_unpin(void* upage){
+  lock_acquire(page_table_lock());
+  struct page_table_node *node = page_search(thread_current()->page_table, upage);
+  ASSERT(node != NULL && node->status == Frame);
+  frame_unpin(node->value);
+  lock_release(page_table_lock());
+}
+
+
+/* pin every page of buffer in memory, so the file system can copy
+   to and from it without faulting while it holds its locks.
+   on failure nothing stays pinned. */
+bool page_pin_buffer(const void* buffer, size_t size, bool write){
+  void* first = pg_round_down(buffer);
+  void* upage;
+  if(!is_user_vaddr(buffer) || size > (size_t)((uint8_t*)PHYS_BASE - (uint8_t*)buffer))
+    return false;
+  for(upage = first; upage < (void*)((uint8_t*)buffer + size); upage += PGSIZE){
+    if(!page_pin(upage, write)){
+      page_unpin_buffer(first, upage - first);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void page_unpin_buffer(const void* buffer, size_t size){
+  void* upage = pg_round_down(buffer);
+  void* end = (uint8_t*)buffer + size;
+  for(; upage < end; upage += PGSIZE)
+    page_unpin(upage);
+}
+
+
 /*utils function*/
 bool page_table_accessible(page_table_type* page_table, void* upage){
   return upage< STACK_BOTTOM_LINE  &&  page_search(page_table,upage) != NULL;
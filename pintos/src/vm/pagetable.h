@@ -35,8 +35,6 @@ struct page_table_node{
 
 */
 
-void page_table_lock_init(void); //OK
-
 /* Basic life cycle. */
 page_table_type *page_table_create(void);//OK
 void page_table_destroy(page_table_type* page_table); //OK
@@ -56,6 +54,10 @@ bool evict_page_to_swap(struct thread *cur, void *upage, swap_index_t index);//O
 /* page fault */
 bool page_fault_handler(const void* vaddr, bool write, void* esp);
 
+/* pinning user buffers for system call I/O */
+bool page_pin_buffer(const void* buffer, size_t size, bool write);
+void page_unpin_buffer(const void* buffer, size_t size);
+
 /*FLY's code end */
 
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "lib/kernel/bitmap.h"
 #include "threads/vaddr.h"
 #include "devices/block.h"
+#include "threads/synch.h"
 #include "swaptable.h"
 
 const uint32_t SECTOR_NUMBER = PGSIZE / BLOCK_SECTOR_SIZE;
@@ -11,6 +12,8 @@ const uint32_t SECTOR_NUMBER = PGSIZE / BLOCK_SECTOR_SIZE;
 struct block *swap_block;
 struct bitmap *swap_map;
 swap_index_t tail_index = 0;
+/* protects swap_map, slots are read and written without it */
+static struct lock swap_lock;
 
 void swap_init (void) {
   swap_block = block_get_role(BLOCK_SWAP);
@@ -18,35 +21,32 @@ void swap_init (void) {
   // uint32_t blocksize = block_size (swap_block);
   // printf ("bitmap_set_all %d %d %d\n", blocksize, SECTOR_NUMBER, blocksize / SECTOR_NUMBER);
   bitmap_set_all (swap_map, false);
+  lock_init (&swap_lock);
 }
 
 void swap_free (swap_index_t index) {
+  lock_acquire (&swap_lock);
   ASSERT (bitmap_test (swap_map, index));
   // printf ("swap_free %d %d\n", index, block_size (swap_block) / SECTOR_NUMBER);
   bitmap_set (swap_map, index, false);
+  lock_release (&swap_lock);
 }
 
 swap_index_t swap_in (void *kpage) {
   ASSERT (is_kernel_vaddr (kpage));
-  swap_index_t index = bitmap_scan (swap_map, 0, 1, false);
+  lock_acquire (&swap_lock);
+  swap_index_t index = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  lock_release (&swap_lock);
   // printf ("swap_in %u %d\n", index, block_size (swap_block) / SECTOR_NUMBER);
-  bitmap_set (swap_map, index, true);
-  uint32_t i;
-  for (i = 0; i < SECTOR_NUMBER; ++i) {
-    block_write (swap_block, index * SECTOR_NUMBER + i, kpage + BLOCK_SECTOR_SIZE * i);
-  }
+  block_write_multiple (swap_block, index * SECTOR_NUMBER, SECTOR_NUMBER, kpage);
   return index;
 }
 
 void swap_out (swap_index_t index, void *kpage) {
   ASSERT (is_kernel_vaddr (kpage));
-  ASSERT (bitmap_test (swap_map, index));
-  uint32_t i;
-  for (i = 0; i < SECTOR_NUMBER; ++i) {
-    block_read (swap_block, index * SECTOR_NUMBER + i, kpage + BLOCK_SECTOR_SIZE * i);
-  }
+  block_read_multiple (swap_block, index * SECTOR_NUMBER, SECTOR_NUMBER, kpage);
   // printf ("swap_out %d %d\n", index, block_size (swap_block) / SECTOR_NUMBER);
-  bitmap_set (swap_map, index, false);
+  swap_free (index);
 }
 
 /* FLY's code end*/
\ No newline at end of file